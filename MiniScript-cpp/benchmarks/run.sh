@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Runs each benchmark script with the given miniscript executable, and
+# reports its run time (and, for a build configured with
+# -DMINISCRIPT_COUNT_RETAINS=ON, its reference-count traffic).
+#
+# To compare two versions, build each with that option, e.g.:
+#
+#   cmake -S . -B build-count -DCMAKE_BUILD_TYPE=Release -DMINISCRIPT_COUNT_RETAINS=ON
+#   cmake --build build-count
+#   MiniScript-cpp/benchmarks/run.sh build-count/miniscript
+#
+# (To count retains in a version from before the option existed, add the
+# counter to RefCountedStorage::retain there by hand.)
+#
+# usage: run.sh path/to/miniscript [script.ms ...]
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 path/to/miniscript [script.ms ...]" >&2
+	exit 1
+fi
+miniscript=$1
+shift
+dir=$(dirname "$0")
+if [ $# -eq 0 ]; then set -- "$dir"/*.ms; fi
+
+for script in "$@"; do
+	echo "== $(basename "$script")"
+	start=$(date +%s.%N)
+	"$miniscript" "$script" || exit 1
+	end=$(date +%s.%N)
+	awk "BEGIN { printf \"time: %.2f s\\n\", $end - $start }"
+done
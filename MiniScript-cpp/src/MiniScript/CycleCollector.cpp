@@ -0,0 +1,213 @@
+//
+//  CycleCollector.cpp
+//  MiniScript
+//
+
+#include "CycleCollector.h"
+#include "MiniscriptTypes.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	thread_local CollectableLink *CycleCollector::ring = nullptr;
+	thread_local long CycleCollector::trackedCount = 0;
+	thread_local long CycleCollector::allocationsSinceCollect = 0;
+	thread_local long CycleCollector::survivors = 0;
+	thread_local bool CycleCollector::collecting = false;
+	thread_local CycleCollector::Stats CycleCollector::totals;
+	long CycleCollector::threshold = 0;
+	void (*CycleCollector::reportCallback)(const Stats& stats) = nullptr;
+
+	CollectableLink *CycleCollector::NewRing() {
+		// The ring starts (and ends) at a link of its own.  That is never freed,
+		// since storage made on this thread may outlive it (e.g. in statics).
+		ring = new CollectableLink();
+		ring->gcPrev = ring->gcNext = ring;
+		return ring;
+	}
+
+	CollectableStorage::CollectableStorage() : gcRefs(0) {
+		CollectableLink *ring = CycleCollector::Ring();
+		gcPrev = ring;
+		gcNext = ring->gcNext;
+		gcNext->gcPrev = this;
+		ring->gcNext = this;
+		CycleCollector::trackedCount++;
+		CycleCollector::allocationsSinceCollect++;
+	}
+
+	CollectableStorage::~CollectableStorage() {
+		gcPrev->gcNext = gcNext;
+		gcNext->gcPrev = gcPrev;
+		CycleCollector::trackedCount--;
+	}
+
+	// Value of gcRefs for storage known to be reachable.
+	static const long reachable = -1;
+
+	CycleCollector::Stats CycleCollector::Collect() {
+		Stats stats;
+		if (collecting) return stats;
+		collecting = true;
+		CollectableLink *ring = Ring();
+
+		// Start each one's count of outside references at its total count...
+		for (CollectableLink *link = ring->gcNext; link != ring; link = link->gcNext) {
+			CollectableStorage *s = static_cast<CollectableStorage*>(link);
+			s->gcRefs = s->refCount;
+			stats.examined++;
+		}
+		// ...then subtract the references from others we know about.
+		for (CollectableLink *link = ring->gcNext; link != ring; link = link->gcNext) {
+			CollectableStorage *s = static_cast<CollectableStorage*>(link);
+			s->VisitChildren([](CollectableStorage *child, void*) { child->gcRefs--; }, nullptr);
+		}
+
+		// Whatever is left with outside references is reachable, and so is
+		// anything we can reach from those.
+		List<CollectableStorage*> toScan;
+		for (CollectableLink *link = ring->gcNext; link != ring; link = link->gcNext) {
+			CollectableStorage *s = static_cast<CollectableStorage*>(link);
+			if (s->gcRefs > 0) {
+				s->gcRefs = reachable;
+				toScan.Add(s);
+			}
+		}
+		while (toScan.Count() > 0) {
+			CollectableStorage *s = toScan.Pop();
+			s->VisitChildren([](CollectableStorage *child, void *data) {
+				if (child->gcRefs == reachable) return;
+				child->gcRefs = reachable;
+				((List<CollectableStorage*>*)data)->Add(child);
+			}, &toScan);
+		}
+
+		// Everything else is garbage.  Hold on to all of it while we break the
+		// references among it, so none is freed while we're still working on it;
+		// then let it go.
+		List<CollectableStorage*> garbage;
+		for (CollectableLink *link = ring->gcNext; link != ring; link = link->gcNext) {
+			CollectableStorage *s = static_cast<CollectableStorage*>(link);
+			if (s->gcRefs != reachable) garbage.Add(s);
+		}
+		for (long i=0; i<garbage.Count(); i++) garbage[i]->retain();
+		for (long i=0; i<garbage.Count(); i++) garbage[i]->ClearChildren();
+		for (long i=0; i<garbage.Count(); i++) {
+			switch (garbage[i]->CollectableKind()) {
+				case CollectableStorage::Kind::List:		stats.lists++;		break;
+				case CollectableStorage::Kind::Map:			stats.maps++;		break;
+				case CollectableStorage::Kind::Function:	stats.functions++;	break;
+			}
+			garbage[i]->release();
+		}
+
+		totals.examined += stats.examined;
+		totals.lists += stats.lists;
+		totals.maps += stats.maps;
+		totals.functions += stats.functions;
+		allocationsSinceCollect = 0;
+		survivors = trackedCount;
+		collecting = false;
+		return stats;
+	}
+
+	void CycleCollector::CollectAndReport() {
+		Stats stats = Collect();
+		if (reportCallback) reportCallback(stats);
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+	//--------------------------------------------------------------------------------
+
+	class TestCycleCollector : public UnitTest
+	{
+	public:
+		TestCycleCollector() : UnitTest("CycleCollector") {}
+		virtual void Run();
+
+	private:
+		void RunInnerTests();
+	};
+
+	void TestCycleCollector::Run() {
+		// Start clean, so we count only the garbage we make here.
+		CycleCollector::Collect();
+#if(DEBUG)
+		// Make sure that everything we make here, cycles included, gets freed.
+		long prevCount = RefCountedStorage::instanceCount;
+#endif
+		RunInnerTests();
+#if(DEBUG)
+		long postCount = RefCountedStorage::instanceCount;
+		Assert(prevCount == postCount);
+#endif
+	}
+
+	void TestCycleCollector::RunInnerTests() {
+		long startCount = CycleCollector::TrackedCount();
+
+		// A list that contains itself.
+		{
+			ValueList list;
+			list.Add(Value(list));
+			list.Add(Value::one);
+		}
+		Assert(CycleCollector::TrackedCount() == startCount + 1);
+		CycleCollector::Stats stats = CycleCollector::Collect();
+		Assert(stats.lists == 1 and stats.maps == 0 and stats.functions == 0);
+		Assert(CycleCollector::TrackedCount() == startCount);
+
+		// A parent and child that refer to each other, with a key that does too.
+		{
+			ValueDict parent;
+			ValueDict child;
+			ValueList key;
+			child.SetValue("parent", parent);
+			parent.SetValue("child", child);
+			key.Add(parent);
+			parent.SetValue(key, Value::one);
+		}
+		stats = CycleCollector::Collect();
+		Assert(stats.lists == 1 and stats.maps == 2 and stats.functions == 0);
+		Assert(CycleCollector::TrackedCount() == startCount);
+
+		// A function whose outer variables contain that function.
+		{
+			Value func(new FunctionStorage());
+			ValueDict outerVars;
+			outerVars.SetValue("f", func);
+			((FunctionStorage*)func.data.ref)->outerVars = outerVars;
+		}
+		stats = CycleCollector::Collect();
+		Assert(stats.lists == 0 and stats.maps == 1 and stats.functions == 1);
+		Assert(CycleCollector::TrackedCount() == startCount);
+
+		// A cycle we can still reach must be kept, along with what it refers to.
+		{
+			ValueList list;
+			ValueDict map;
+			map.SetValue("list", list);
+			list.Add(map);
+			list.Add(ValueList());
+			stats = CycleCollector::Collect();
+			Assert(stats.Freed() == 0);
+			Assert(list.Count() == 2 and list[0].GetDict().Count() == 1);
+			Assert(list[1].type == ValueType::List);
+		}
+		stats = CycleCollector::Collect();
+		Assert(stats.lists == 2 and stats.maps == 1);
+		Assert(CycleCollector::TrackedCount() == startCount);
+
+		// Nor does plain, acyclic data leave anything to collect.
+		{
+			ValueList list;
+			list.Add(ValueDict());
+		}
+		Assert(CycleCollector::TrackedCount() == startCount);
+		Assert(CycleCollector::Collect().Freed() == 0);
+	}
+
+	RegisterUnitTest(TestCycleCollector);
+
+}
@@ -0,0 +1,131 @@
+//
+//  CycleCollector.h
+//  MiniScript
+//
+//	Reference counting alone never frees a group of lists, maps and functions
+//	that refer to each other in a cycle: a list that contains itself, a pair of
+//	maps that point to each other, or a function whose outerVars contains that
+//	function.  This file defines an (optional) collector for such garbage.
+//
+//	It works by trial deletion: for every list, map and function, it subtracts
+//	the references that come from other lists, maps and functions from its
+//	reference count.  Whatever still has references left is referred to from
+//	somewhere else (a variable, a temp, the host app), so it and everything it
+//	refers to is live.  Anything else is unreachable, and is freed.  References
+//	from anywhere the collector can't see into count as outside references, so
+//	it errs on the side of keeping things.
+//
+//	The collector runs when the host calls CycleCollector::Collect, and also
+//	(at a safe point in the running script) after a given number of new lists,
+//	maps and functions, if the host has set a threshold.
+//
+
+#ifndef CYCLECOLLECTOR_H
+#define CYCLECOLLECTOR_H
+
+#include "RefCountedStorage.h"
+
+namespace MiniScript {
+
+	// Links in a ring of collectable storage (one ring per thread).
+	struct CollectableLink {
+		CollectableLink *gcPrev;
+		CollectableLink *gcNext;
+	};
+
+	/// <summary>
+	/// CollectableStorage: the base class of storage that can hold Values, and so
+	/// may be part of a reference cycle (i.e., that of lists, maps and functions).
+	/// Each one is kept in a ring with all others made on the same thread, so the
+	/// collector can find them all.
+	/// </summary>
+	class CollectableStorage : public RefCountedStorage, private CollectableLink {
+	public:
+		enum class Kind : unsigned char {
+			List,
+			Map,
+			Function
+		};
+
+		// Call the given function on each collectable storage we refer to.
+		typedef void (*Visitor)(CollectableStorage *child, void *data);
+		virtual void VisitChildren(Visitor visit, void *data) = 0;
+
+		// Drop all our references to other values (as we've been found to be garbage).
+		virtual void ClearChildren() = 0;
+
+		virtual Kind CollectableKind() const = 0;
+
+	protected:
+		CollectableStorage();
+		virtual ~CollectableStorage();
+
+	private:
+		long gcRefs;		// (used only during collection)
+
+		friend class CycleCollector;
+	};
+
+	class CycleCollector {
+	public:
+		// What a collection found and freed.
+		struct Stats {
+			long examined;		// lists, maps and functions looked at
+			long lists;			// ...and how many of each of these were freed
+			long maps;
+			long functions;
+
+			Stats() : examined(0), lists(0), maps(0), functions(0) {}
+			long Freed() const { return lists + maps + functions; }
+		};
+
+		/// <summary>
+		/// Find and free all lists, maps and functions that can no longer be
+		/// reached (of those made on the calling thread).  Call this only between
+		/// running scripts, or from an intrinsic; not while in the middle of
+		/// changing some map or list.
+		/// </summary>
+		/// <returns>what was freed</returns>
+		static Stats Collect();
+
+		// Collect automatically (at safe points in a running script) after this
+		// many new lists, maps and functions; or never, if 0 (the default).
+		// (But we always wait for at least half as many as survived the last
+		// collection, so that the cost stays proportional to allocation.)
+		static long threshold;
+
+		// If set, this is called with the results of each automatic collection.
+		static void (*reportCallback)(const Stats& stats);
+
+		// Totals over all collections so far (on this thread).
+		static thread_local Stats totals;
+
+		// Number of lists, maps and functions that currently exist (made on this thread).
+		static long TrackedCount() { return trackedCount; }
+
+		static bool ShouldCollect() {
+			return threshold > 0 and allocationsSinceCollect >= threshold
+				and allocationsSinceCollect >= survivors / 2;
+		}
+
+		// Collect (and report) if ShouldCollect; for use at safe points.
+		static void CollectIfDue() { if (ShouldCollect()) CollectAndReport(); }
+
+	private:
+		static void CollectAndReport();
+
+		static CollectableLink *Ring() { return ring ? ring : NewRing(); }
+		static CollectableLink *NewRing();
+
+		static thread_local CollectableLink *ring;
+		static thread_local long trackedCount;
+		static thread_local long allocationsSinceCollect;
+		static thread_local long survivors;
+		static thread_local bool collecting;
+
+		friend class CollectableStorage;
+	};
+
+}
+
+#endif /* CYCLECOLLECTOR_H */
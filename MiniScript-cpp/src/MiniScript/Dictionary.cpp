@@ -9,9 +9,20 @@
 #include "Dictionary.h"
 #include "UnitTest.h"
 #include "SimpleString.h"
+#include <atomic>
 
 namespace MiniScript {
 	
+	thread_local unsigned long long UniqueNumbers::next = 0;
+	thread_local unsigned long long UniqueNumbers::blockEnd = 0;
+
+	unsigned long long UniqueNumbers::StartBlock() {
+		static std::atomic<unsigned long long> blocksUsed(0);
+		next = blocksUsed.fetch_add(1) * blockSize;
+		blockEnd = next + blockSize;
+		return ++next;
+	}
+
 	class TestDictionary : public UnitTest
 	{
 	public:
@@ -65,7 +76,119 @@ namespace MiniScript {
 		for (int i=0; i<1000; i++) {
 			Assert(d2.Lookup(i, -1) == i*i);
 		}
+		
+		// The epoch changes when keys are added or removed, but not when values change.
+		unsigned long long epoch = d2.Epoch();
+		int *p = d2.GetValuePointer(42);
+		Assert(p != nullptr and *p == 42*42);
+		d2.SetValue(42, -42);
+		Assert(d2.Epoch() == epoch and *p == -42);
+		Assert(d2.GetValuePointer(1000) == nullptr);
+		d2.SetValue(1000, 0);
+		Assert(d2.Epoch() != epoch);
+		epoch = d2.Epoch();
+		d2.Remove(1000);
+		Assert(d2.Epoch() != epoch);
+		Assert(d.Epoch() != d2.Epoch());
+		
+		// The table grows as needed (but starts small), and probe sequences stay short.
+		Dictionary<int, int, hashInt> d3;
+		Assert(d3.Capacity() == 0);
+		d3.SetValue(1, 1);
+		Assert(d3.Capacity() > 0 and d3.Capacity() <= 8);
+		Assert(d2.Capacity() >= 1000 and d2.Capacity() < 4000);
+		Assert(d2.IsHashed() and d2.MaxProbeDistance() < 16);
+		
+		// A small map isn't hashed at all, until it outgrows that; either way,
+		// removals (and holes left by them) work the same.
+		for (int i=2; i<=8; i++) d3.SetValue(i, i*10);
+		Assert(not d3.IsHashed() and d3.Count() == 8);
+		d3.Remove(1);
+		d3.Remove(4);
+		Assert(not d3.ContainsKey(4) and d3.Lookup(5, 0) == 50 and d3.KeyAt(0) == 2);
+		d3.SetValue(9, 90);
+		d3.SetValue(10, 100);
+		Assert(not d3.IsHashed() and d3.KeyAt(7) == 10);
+		d3.SetValue(11, 110);
+		Assert(d3.IsHashed() and d3.Count() == 9);
+		for (int i=1; i<=11; i++) Assert(d3.Lookup(i, 0) == (i == 1 or i == 4 ? 0 : i*10));
+		d3.RemoveAll();
+		Assert(not d3.IsHashed() and d3.Count() == 0 and not d3.ContainsKey(2));
+		d3.SetValue(2, 2);
+		Assert(d3.Lookup(2, 0) == 2 and d3.Capacity() <= 8);
+		
+		// That includes keys that need freeing, like strings.
+		d.SetValue("a", 1);
+		d.SetValue("b", 2);
+		d.Remove("a");
+		for (int i=0; i<10; i++) d.SetValue(String("key") + String::Format(i), i);
+		Assert(d.Count() == 11 and d.KeyAt(0) == "b" and d.Lookup("key9", 0) == 9);
+		d.RemoveAll();
 
+		// Removing keys leaves all the others findable, and iteration sees each one once.
+		for (int i=0; i<1000; i+=3) Assert(d2.Remove(i));
+		Assert(not d2.Remove(3));
+		Assert(d2.Count() == 666);
+		long sum = 0, count = 0;
+		for (DictIterator<int, int> kv = d2.GetIterator(); !kv.Done(); kv.Next()) {
+			Assert(kv.Key() % 3 != 0);
+			sum += kv.Key();
+			count++;
+		}
+		Assert(count == 666 and sum == 499500 - 166833);
+		for (int i=0; i<1000; i++) {
+			Assert(d2.ContainsKey(i) == (i % 3 != 0));
+		}
+		Assert(d2.Keys().Count() == 666 and d2.Values().Count() == 666);
+		d2.RemoveAll();
+		Assert(d2.Count() == 0 and d2.GetIterator().Done());
+		
+		// Entries keep the order in which they were added, even after removals,
+		// and can be found by position.
+		for (int i=0; i<100; i++) d2.SetValue(i, i*i);
+		for (int i=0; i<100; i+=2) d2.Remove(i);
+		d2.SetValue(0, 0);
+		Assert(d2.Count() == 51);
+		Assert(d2.KeyAt(0) == 1 and d2.KeyAt(49) == 99 and d2.KeyAt(50) == 0);
+		Assert(d2.ValueAt(1) == 9);
+		int expected = 1;
+		for (DictIterator<int, int> kv = d2.GetIterator(); !kv.Done(); kv.Next()) {
+			Assert(kv.Key() == expected);
+			expected = (expected == 99 ? 0 : expected + 2);
+		}
+		
+		// Removing from the front (as 'pull' does) doesn't leave holes to skip over.
+		while (d2.Count() > 1) d2.Remove(d2.KeyAt(0));
+		Assert(d2.KeyAt(0) == 0 and d2.Keys()[0] == 0);
+		
+		// Dictionaries started from the same owner share their shape, for as
+		// long as they get the same keys in the same order.
+		Dictionary<String, int, hashString> cls, a, b, c;
+		Assert(a.ShapeId() == 0);
+		a.StartShape(cls);
+		b.StartShape(cls);
+		c.StartShape(cls);
+		for (int i=0; i<12; i++) {
+			a.SetValue(String("f") + String::Format(i), i);
+			b.SetValue(String("f") + String::Format(i), -i);
+		}
+		c.SetValue("f0", 0);
+		c.SetValue("other", 1);
+		Assert(a.ShapeId() != 0 and a.ShapeId() == b.ShapeId() and c.ShapeId() != a.ShapeId());
+		Assert(a.Count() == 12 and a.Lookup("f11", 0) == 11 and b.Lookup("f11", 0) == -11);
+		Assert(b.IndexOf("f7") == 7 and *b.ValuePointerAt(7) == -7 and b.KeyAt(11) == "f11");
+		Assert(a.IsHashed() and not b.ContainsKey("other") and c.Lookup("other", 0) == 1);
+		
+		// Changing a value doesn't change the shape, but removing a key stops sharing.
+		a.SetValue("f3", 33);
+		Assert(a.ShapeId() == b.ShapeId() and b.Lookup("f3", 0) == -3);
+		b.Remove("f3");
+		Assert(b.ShapeId() == 0 and b.Count() == 11 and not b.ContainsKey("f3"));
+		Assert(b.Lookup("f4", 0) == -4 and a.Lookup("f3", 0) == 33);
+		b.SetValue("f3", 3);
+		Assert(b.KeyAt(11) == "f3");
+		a.RemoveAll();
+		Assert(a.ShapeId() == 0 and a.Count() == 0 and not a.ContainsKey("f0"));
 	}
 
 	RegisterUnitTest(TestDictionary);
@@ -3,6 +3,24 @@
  *
  *  Created by Ryan on 3/15/11.
  *
+ *  The entries are kept in the order they were added, in two parallel arrays:
+ *  one of keys (with their cached hashes), and one of values.  They are found
+ *  via a separate, sparse table of slots, using open addressing with Robin
+ *  Hood probing: each slot refers to an entry, and is kept as close as possible
+ *  to where the hash of its key says it should be.  All start small, and grow
+ *  as needed.
+ *
+ *  Removing a key just marks its entry as removed, so the others keep their
+ *  order (and place); the holes are squeezed out when the table is resized,
+ *  or when we need to find an entry by its position.
+ *
+ *  Most maps are small (e.g. objects with a handful of fields), so until a
+ *  map has more than a few keys, its entries are kept inline in the storage
+ *  itself, and there is no slot table: we just scan the entries.
+ *
+ *  Many maps also have the same keys as each other (e.g. objects of the same
+ *  class).  Such maps can share a shape: one copy of the keys and slot table,
+ *  leaving each map with just its values.
  */
 
 #ifndef HASHMAP_H
@@ -12,51 +30,466 @@
 
 namespace MiniScript {
 
-	// This is the number of hash cells in the table
-	// this will work best as a prime number
-	// samples: 101, 521, 1009
-	#define TABLE_SIZE 251
-
 	template <class K, class V, unsigned int HASH(const K&)> class Dictionary;
 	
-	template <class K, class V>
-	class HashMapEntry
+	// Hands out numbers that are never reused, on any thread (e.g. for epochs).
+	// Each thread takes them from a block of its own, so this rarely needs to
+	// synchronize with other threads.
+	class UniqueNumbers {
+	public:
+		// Get a number (greater than 0) that has never been returned before.
+		static unsigned long long Next() { return next < blockEnd ? ++next : StartBlock(); }
+	private:
+		static const unsigned long long blockSize = 1 << 16;
+		static unsigned long long StartBlock();
+		static thread_local unsigned long long next;
+		static thread_local unsigned long long blockEnd;
+	};
+
+	template <class K>
+	class DictionaryKey
 	{
 	public:
-		HashMapEntry() : next(nullptr) {}
-		~HashMapEntry() { if (next) delete next; }
-		
-		HashMapEntry *Clone() {
-			HashMapEntry *result = new HashMapEntry();
-			result->key = key;
-			result->value = value;
-			if (next) result->next = next->Clone();
+		DictionaryKey() : hash(0), removed(false) {}
+		
+		K key;
+		unsigned int hash;		// cached result of the hash function on key
+		bool removed;			// true if this key has been removed (leaving a hole)
+	};
+	
+	class DictionarySlot
+	{
+	public:
+		DictionarySlot() : hash(0), entry(0) {}
+		
+		unsigned int hash;		// hash of the entry's key (so we rarely need to look at the entry)
+		unsigned int entry;		// 1 + index of the entry; 0 if this slot is empty
+
+		// Return how far the given slot is from where its hash says it should be.
+		static unsigned long DistanceAt(const DictionarySlot *slots, long capacity, unsigned long i) {
+			return (i - slots[i].hash) & (capacity - 1);
+		}
+		
+		// Put a slot referring to the given entry into the table, which must
+		// have room for it.
+		static void Place(DictionarySlot *slots, long capacity, unsigned int hash, unsigned int entry) {
+			unsigned long mask = capacity - 1;
+			unsigned long i = hash & mask;
+			unsigned long distance = 0;
+			while (true) {
+				DictionarySlot& slot = slots[i];
+				if (slot.entry == 0) {
+					slot.hash = hash;
+					slot.entry = entry;
+					return;
+				}
+				unsigned long slotDistance = DistanceAt(slots, capacity, i);
+				if (slotDistance < distance) {
+					// Robin Hood: this slot is closer to home than ours, so ours
+					// takes its place, and we go on to find a place for it instead.
+					unsigned int tempHash = slot.hash;
+					unsigned int tempEntry = slot.entry;
+					slot.hash = hash;
+					slot.entry = entry;
+					hash = tempHash;
+					entry = tempEntry;
+					distance = slotDistance;
+				}
+				i = (i + 1) & mask;
+				distance++;
+			}
+		}
+	};
+
+	// A shape is a list of keys, shared by all the dictionaries that were
+	// started from the same owner (see Dictionary::StartShape) and then had
+	// those same keys added in the same order.  Such a dictionary stores only
+	// its values, and borrows its keys (and slot table) from its shape.
+	// A shape never changes, except to remember the shapes that follow from
+	// it by adding one more key.
+	template <class K>
+	class DictionaryShape : public RefCountedStorage {
+	private:
+		// A shape has at most this many keys, and leads to at most this many
+		// other shapes; a dictionary that would go beyond that stops sharing.
+		static const long maxKeys = 64;
+		static const int maxTransitions = 8;
+
+		DictionaryShape() : RefCountedStorage(), count(0), capacity(0), keys(nullptr), slots(nullptr), transitionCount(0), id(UniqueNumbers::Next()) {}
+		~DictionaryShape() {
+			for (int i=0; i<transitionCount; i++) transitions[i]->release();
+			MemoryAccount::DeleteArray(keys);
+			MemoryAccount::DeleteArray(slots);
+		}
+		
+		// Get the shape that follows from this one by adding the given key
+		// (which must not already be here), with a slot table of the given
+		// capacity (0 for none).  Return nullptr if that's too many shapes.
+		DictionaryShape* Transition(const K& key, unsigned int hash, long slotCapacity) {
+			for (int i=0; i<transitionCount; i++) {
+				DictionaryKey<K>& last = transitions[i]->keys[count];
+				if (last.hash == hash and last.key == key) return transitions[i];
+			}
+			if (count >= maxKeys or transitionCount >= maxTransitions) return nullptr;
+			DictionaryShape *result = new DictionaryShape();
+			try {
+				result->keys = MemoryAccount::NewArray<DictionaryKey<K>>(count + 1);
+				if (slotCapacity) result->slots = MemoryAccount::NewArray<DictionarySlot>(slotCapacity);
+			} catch (...) {
+				result->release();
+				throw;
+			}
+			result->count = count + 1;
+			for (long i=0; i<count; i++) result->keys[i] = keys[i];
+			result->keys[count].key = key;
+			result->keys[count].hash = hash;
+			if (slotCapacity) {
+				result->capacity = slotCapacity;
+				for (long i=0; i<=count; i++) {
+					DictionarySlot::Place(result->slots, slotCapacity, result->keys[i].hash, (unsigned int)i + 1);
+				}
+			}
+			transitions[transitionCount++] = result;	// (we keep the reference it starts with)
 			return result;
 		}
 		
-		HashMapEntry<K, V> *next;
-		K key;
-		V value;
+		long count;							// number of keys
+		long capacity;						// number of slots (0 if there is no slot table)
+		DictionaryKey<K> *keys;				// the keys, in the order they were added
+		DictionarySlot *slots;				// slot table for finding them, or nullptr
+		DictionaryShape *transitions[maxTransitions];	// shapes with one more key
+		int transitionCount;
+		unsigned long long id;				// unique across all shapes (unlike pointers, never reused)
+		
+		template <class K2, class V2> friend class DictionaryStorage;
+		template <class K2, class V2, unsigned int HASH(const K2&)> friend class Dictionary;
 	};
+	
+	// The base class of a map's storage.  Maps that can hold maps (i.e. of
+	// Value to Value) specialize this to be CollectableStorage; see MiniscriptTypes.h.
+	template <class K, class V>
+	struct DictionaryStorageBase { typedef RefCountedStorage Type; };
 
 	template <class K, class V>
-	class DictionaryStorage : public RefCountedStorage {
+	class DictionaryStorage : public DictionaryStorageBase<K, V>::Type {
+	public:
+		// cycle collection support (used only when our base is CollectableStorage)
+		void VisitChildren(CollectableStorage::Visitor visit, void *data) {
+			for (long i=mFirst; i<mUsed; i++) {
+				if (mKeys[i].removed) continue;
+				// (keys in a shape belong to the shape, not to us)
+				if (!mShape) VisitCollectable(mKeys[i].key, visit, data);
+				VisitCollectable(mValues[i], visit, data);
+			}
+		}
+		void ClearChildren() { RemoveAll(); }
+		CollectableStorage::Kind CollectableKind() const { return CollectableStorage::Kind::Map; }
+
 	private:
-		DictionaryStorage() : RefCountedStorage(), mSize(0), assignOverride(nullptr), evalOverride(nullptr) { for (int i=0; i<TABLE_SIZE; i++) mTable[i] = nullptr; }
-		~DictionaryStorage() { RemoveAll(); }
+		DictionaryStorage() : mSize(0), mFirst(0), mUsed(0), mCapacity(0), mEntryCapacity(inlineCount),
+			mSlots(nullptr), mKeys(mInlineKeys), mValues(mInlineValues), mShape(nullptr), mInstanceShape(nullptr),
+			assignOverride(nullptr), evalOverride(nullptr) { Touch(); }
+		~DictionaryStorage() {
+			if (mShape) mShape->release();
+			else {
+				MemoryAccount::DeleteArray(mSlots);
+				if (mKeys != mInlineKeys) MemoryAccount::DeleteArray(mKeys);
+			}
+			if (mValues != mInlineValues) MemoryAccount::DeleteArray(mValues);
+			if (mInstanceShape) mInstanceShape->release();
+		}
+
+		// Number of entries kept right here in the storage, so a small map
+		// needs no further allocation.
+		static const long inlineCount = 4;
+		
+		// Maps with up to this many entries have no slot table at all; we just
+		// scan the entries (comparing cached hashes first), which for so few
+		// is faster than hashing into a table, and takes less memory.
+		static const long maxLinear = 8;
+		
+		// We keep the slot table at most 3/4 full, so probe sequences stay short.
+		// So that's also how many entries we have room for.
+		static long EntryCapacity(long slotCapacity) { return slotCapacity / 4 * 3; }
+		
+		// Get how many entries we have room for after growing from the given number.
+		static long NextEntryCapacity(long entryCapacity) {
+			if (entryCapacity < maxLinear) return maxLinear;
+			return EntryCapacity(entryCapacity / 3 * 4 * 2);
+		}
 
 		void RemoveAll() {
-			for (int i = 0; i < TABLE_SIZE; i++) {
-				if (mTable[i]) {
-					delete mTable[i];
-					mTable[i] = nullptr;
+			// (Detach the arrays before clearing them, in case releasing a value
+			// somehow leads back to this storage.  Inline entries are moved out
+			// to temporary arrays for the same reason.)
+			DictionaryShape<K> *oldShape = mShape;
+			DictionarySlot *oldSlots = mShape ? nullptr : mSlots;
+			DictionaryKey<K> *oldKeys = mKeys;
+			V *oldValues = mValues;
+			DictionaryKey<K> oldInlineKeys[inlineCount];
+			V oldInlineValues[inlineCount];
+			for (long i=0; i<inlineCount; i++) {
+				oldInlineKeys[i] = std::move(mInlineKeys[i]);
+				mInlineKeys[i] = DictionaryKey<K>();
+				oldInlineValues[i] = std::move(mInlineValues[i]);
+				mInlineValues[i] = V();
+			}
+			mShape = nullptr;
+			mSlots = nullptr;
+			mKeys = mInlineKeys;
+			mValues = mInlineValues;
+			mCapacity = 0;
+			mEntryCapacity = inlineCount;
+			mSize = mFirst = mUsed = 0;
+			Touch();
+			MemoryAccount::DeleteArray(oldSlots);
+			if (oldShape) oldShape->release();
+			else if (oldKeys != mInlineKeys) MemoryAccount::DeleteArray(oldKeys);
+			if (oldValues != mInlineValues) MemoryAccount::DeleteArray(oldValues);
+			(void)oldInlineValues;	// (released only now, as it goes out of scope)
+		}
+		
+		// Return how far the given slot is from where its hash says it should be.
+		unsigned long DistanceAt(unsigned long i) const {
+			return DictionarySlot::DistanceAt(mSlots, mCapacity, i);
+		}
+		
+		// Find the index of the slot referring to the given key, or -1 if not
+		// found.  (Only for a hashed map, i.e. one with a slot table.)
+		long FindSlot(const K& key, unsigned int hash) const {
+			if (mSize == 0) return -1;
+			unsigned long mask = mCapacity - 1;
+			unsigned long i = hash & mask;
+			for (unsigned long distance = 0; ; distance++) {
+				const DictionarySlot& slot = mSlots[i];
+				// Slots are kept in order of distance along a probe sequence,
+				// so once we pass one closer to home than we are, the key isn't here.
+				if (slot.entry == 0 or DistanceAt(i) < distance) return -1;
+				// Note: We rely here on our key types defining == in a way
+				// that is intended to equate keys that should be unique in
+				// the dictionary (and consistent with the hash function).
+				if (slot.hash == hash and mKeys[slot.entry - 1].key == key) return i;
+				i = (i + 1) & mask;
+			}
+		}
+		
+		// Find the index of the entry for the given key, or -1 if not found.
+		long Find(const K& key, unsigned int hash) const {
+			if (mSlots == nullptr) {
+				for (long i=mFirst; i<mUsed; i++) {
+					const DictionaryKey<K>& entry = mKeys[i];
+					if (entry.hash == hash and not entry.removed and entry.key == key) return i;
 				}
+				return -1;
+			}
+			long i = FindSlot(key, hash);
+			return i < 0 ? -1 : (long)mSlots[i].entry - 1;
+		}
+		
+		// Add a key that is not already in the table.  (Key and value are
+		// taken by value, since growing would invalidate references into it.)
+		void Insert(K key, V value, unsigned int hash) {
+			if (mShape) {
+				if (InsertShaped(key, value, hash)) return;
+				Resize(mEntryCapacity);		// (stop sharing keys)
+			}
+			if (mUsed >= mEntryCapacity) {
+				// Out of room.  If that's mostly because of holes, squeeze them out;
+				// otherwise, grow: first out of the inline entries, then into a
+				// hashed table, which then doubles each time.
+				if (mSize < mUsed / 2) Resize(mEntryCapacity);
+				else Resize(NextEntryCapacity(mEntryCapacity));
+			}
+			DictionaryKey<K>& entry = mKeys[mUsed];
+			entry.key = std::move(key);
+			entry.hash = hash;
+			entry.removed = false;
+			mValues[mUsed] = std::move(value);
+			mUsed++;
+			mSize++;
+			if (mSlots) DictionarySlot::Place(mSlots, mCapacity, hash, (unsigned int)mUsed);
+			Touch();
+		}
+		
+		// Add a key to a map that shares its keys, by moving it on to the next
+		// shape.  Return false (changing nothing) if there's no such shape;
+		// otherwise the value is moved in.
+		bool InsertShaped(const K& key, V& value, unsigned int hash) {
+			long slotCapacity = 0;
+			if (mSize + 1 > maxLinear) {
+				slotCapacity = maxLinear * 2;
+				while (EntryCapacity(slotCapacity) < mSize + 1) slotCapacity *= 2;
+			}
+			DictionaryShape<K> *next = mShape->Transition(key, hash, slotCapacity);
+			if (not next) return false;
+			if (mUsed >= mEntryCapacity) ResizeValues(NextEntryCapacity(mEntryCapacity));
+			mValues[mUsed] = std::move(value);
+			mUsed++;
+			mSize++;
+			next->retain();
+			mShape->release();
+			mShape = next;
+			mKeys = next->keys;
+			mSlots = next->slots;
+			mCapacity = next->capacity;
+			Touch();
+			return true;
+		}
+		
+		// Remove the given key, if found, storing its value in output (if given).
+		bool Remove(const K& key, unsigned int hash, V *output) {
+			if (mShape) {
+				if (Find(key, hash) < 0) return false;
+				Resize(mEntryCapacity);		// (stop sharing keys)
+			}
+			long index;
+			if (mSlots == nullptr) {
+				index = Find(key, hash);
+				if (index < 0) return false;
+			} else {
+				long slotIndex = FindSlot(key, hash);
+				if (slotIndex < 0) return false;
+				index = (long)mSlots[slotIndex].entry - 1;
+				RemoveSlot(slotIndex);
 			}
-			mSize = 0;
+			if (output) *output = mValues[index];
+			
+			// Leave a hole where the entry was (or, at either end, just trim it off).
+			// (Hang on to the old key and value until the table is consistent.)
+			DictionaryKey<K>& entry = mKeys[index];
+			K oldKey = entry.key;
+			V oldValue = mValues[index];
+			entry.key = K();
+			entry.removed = true;
+			mValues[index] = V();
+			mSize--;
+			while (mFirst < mUsed and mKeys[mFirst].removed) mFirst++;
+			while (mUsed > mFirst and mKeys[mUsed - 1].removed) mUsed--;
+			if (mSize == 0) mFirst = mUsed = 0;
+			Touch();
+			(void)oldKey; (void)oldValue;	// (released only now, as they go out of scope)
+			return true;
 		}
 		
-		long mSize;
-		HashMapEntry<K, V> *mTable[TABLE_SIZE];
+		// Take the given slot out of the table, shifting back the slots after
+		// it in its probe sequence to fill the gap.
+		void RemoveSlot(long slotIndex) {
+			unsigned long mask = mCapacity - 1;
+			unsigned long i = slotIndex;
+			unsigned long next = (i + 1) & mask;
+			while (mSlots[next].entry and DistanceAt(next) > 0) {
+				mSlots[i] = mSlots[next];
+				i = next;
+				next = (next + 1) & mask;
+			}
+			mSlots[i].entry = 0;
+		}
+		
+		// Return the index of the entry at the given position (counting only
+		// entries that have not been removed), squeezing out any holes first.
+		long EntryIndex(long position) {
+			if (mUsed - mFirst != mSize) Resize(mEntryCapacity);
+			return mFirst + position;
+		}
+		
+		// Reallocate the entries with room for the given number of them, which
+		// must be no more than maxLinear (no slot table), or EntryCapacity of
+		// a power of 2 (with a slot table of that size).  Any holes left by
+		// removed entries are squeezed out; inline entries that still fit are
+		// just squeezed in place.  If we were sharing keys with a shape, we
+		// now get our own copy of them.
+		void Resize(long newEntryCapacity) {
+			// (Allocate everything first, so if that fails, we're unchanged.)
+			long newCapacity = newEntryCapacity > maxLinear ? newEntryCapacity / 3 * 4 : 0;
+			DictionarySlot *newSlots = nullptr;
+			DictionaryKey<K> *newKeys = mInlineKeys;
+			V *newValues = mInlineValues;
+			try {
+				if (newCapacity) newSlots = MemoryAccount::NewArray<DictionarySlot>(newCapacity);
+				if (newEntryCapacity > inlineCount) {
+					newKeys = MemoryAccount::NewArray<DictionaryKey<K>>(newEntryCapacity);
+					newValues = MemoryAccount::NewArray<V>(newEntryCapacity);
+				}
+			} catch (...) {
+				MemoryAccount::DeleteArray(newSlots);
+				if (newKeys != mInlineKeys) MemoryAccount::DeleteArray(newKeys);
+				throw;
+			}
+			DictionaryShape<K> *oldShape = mShape;
+			DictionarySlot *oldSlots = mShape ? nullptr : mSlots;
+			DictionaryKey<K> *oldKeys = mKeys;
+			V *oldValues = mValues;
+			long oldUsed = mUsed;
+			mShape = nullptr;
+			mCapacity = newCapacity;
+			mSlots = newSlots;
+			mKeys = newKeys;
+			mValues = newValues;
+			mEntryCapacity = newEntryCapacity;
+			long count = 0;
+			for (long i=mFirst; i<oldUsed; i++) {
+				if (oldKeys[i].removed) continue;
+				// (Keys shared with a shape must be copied; anything else is moved.)
+				if (oldShape) mKeys[count] = oldKeys[i];
+				else if (mKeys != oldKeys or count != i) mKeys[count] = std::move(oldKeys[i]);
+				if (mValues != oldValues or count != i) mValues[count] = std::move(oldValues[i]);
+				if (mSlots) DictionarySlot::Place(mSlots, mCapacity, mKeys[count].hash, (unsigned int)count + 1);
+				count++;
+			}
+			mFirst = 0;
+			mUsed = count;
+			// Clear out any inline entries we've moved (or moved down) from.
+			// Each is now empty or a duplicate, so this never frees anything.
+			if (oldKeys == mInlineKeys) {
+				for (long i = (mKeys == mInlineKeys ? count : 0); i < oldUsed; i++) mInlineKeys[i] = DictionaryKey<K>();
+			} else if (not oldShape) MemoryAccount::DeleteArray(oldKeys);
+			if (oldValues == mInlineValues) {
+				for (long i = (mValues == mInlineValues ? count : 0); i < oldUsed; i++) mInlineValues[i] = V();
+			} else MemoryAccount::DeleteArray(oldValues);
+			MemoryAccount::DeleteArray(oldSlots);
+			if (oldShape) oldShape->release();
+			Touch();
+		}
+		
+		// Reallocate just the values (of a map that shares its keys), with
+		// room for the given number of them.
+		void ResizeValues(long newEntryCapacity) {
+			V *oldValues = mValues;
+			mValues = MemoryAccount::NewArray<V>(newEntryCapacity);
+			mEntryCapacity = newEntryCapacity;
+			for (long i=0; i<mUsed; i++) mValues[i] = std::move(oldValues[i]);
+			if (oldValues == mInlineValues) {
+				for (long i=0; i<mUsed; i++) mInlineValues[i] = V();
+			} else MemoryAccount::DeleteArray(oldValues);
+		}
+
+		// Start sharing keys with other dictionaries started from the given
+		// owner.  (This one must be empty.)
+		void StartShape(DictionaryStorage *owner) {
+			if (mSize > 0 or mShape) return;
+			if (not owner->mInstanceShape) owner->mInstanceShape = new DictionaryShape<K>();
+			RemoveAll();
+			mShape = owner->mInstanceShape;
+			mShape->retain();
+			mKeys = mShape->keys;	// (nullptr, but that's fine with no keys)
+		}
+
+		// Note that a key has been added or removed (or entries have moved).
+		void Touch() { epoch = UniqueNumbers::Next(); }
+		
+		long mSize;							// number of entries (not counting removed ones)
+		long mFirst;						// index of the first entry not removed (if any)
+		long mUsed;							// number of entries in use, including removed ones
+		long mCapacity;						// number of slots (0, or a power of 2)
+		long mEntryCapacity;				// number of entries we have room for
+		DictionarySlot *mSlots;				// the hash table (nullptr while the map is small)
+		DictionaryKey<K> *mKeys;			// the keys of the entries, in the order they were added...
+		V *mValues;							// ...and their values
+		DictionaryShape<K> *mShape;			// if not null, the shape that mKeys and mSlots belong to
+		DictionaryShape<K> *mInstanceShape;	// shape for maps started from this one (see StartShape)
+		DictionaryKey<K> mInlineKeys[inlineCount];	// where the entries are kept at first
+		V mInlineValues[inlineCount];
+		unsigned long long epoch;			// changes whenever a key is added or removed (unique across all storages)
 
 		void *assignOverride;
 		void *evalOverride;
@@ -69,13 +502,13 @@ namespace MiniScript {
 	template <class K, class V>
 	class DictIterator {
 	public:
-		bool Done() const { return entry == nullptr; }
-		K Key() const { return entry->key;}
-		V Value() const { return entry->value; }
-		void Next();
+		bool Done() const { return storage == nullptr or index >= storage->mUsed; }
+		K Key() const { return storage->mKeys[index].key;}
+		V Value() const { return storage->mValues[index]; }
+		void Next() { index++; SkipRemoved(); }
 		
 		bool operator==(const DictIterator<K, V>& other) {
-			return storage == other.storage and binIndex == other.binIndex and entry == other.entry;
+			return storage == other.storage and index == other.index;
 		}
 		
 		bool operator!=(const DictIterator<K, V>& other) {
@@ -83,10 +516,16 @@ namespace MiniScript {
 		}
 		
 	private:
-		DictIterator(DictionaryStorage<K, V> *storage);
+		DictIterator(DictionaryStorage<K, V> *storage) : storage(storage), index(storage ? storage->mFirst : 0) { SkipRemoved(); }
+		
+		// Advance past any entries that have been removed.
+		void SkipRemoved() {
+			if (!storage) return;
+			while (index < storage->mUsed and storage->mKeys[index].removed) index++;
+		}
+		
 		DictionaryStorage<K, V> *storage;
-		int binIndex;
-		HashMapEntry<K, V> *entry;
+		long index;
 
 		template <class K2, class V2, unsigned int HASH(const K2&)> friend class Dictionary;
 	};
@@ -109,17 +548,44 @@ namespace MiniScript {
 		/// OPERATORS
 		
 		// Assignment Operator
-		Dictionary& operator=(const Dictionary &other) { ((Dictionary&)other).ensureStorage(); other.ds->refCount++; release(); ds = other.ds; isTemp = false; return *this; }
+		Dictionary& operator=(const Dictionary &other) { ((Dictionary&)other).ensureStorage(); other.ds->retain(); release(); ds = other.ds; isTemp = false; return *this; }
+		
+		// Move Constructor and Assignment Operator: take over the other's reference
+		// (unless it's a temp, which has none to give, in which case we copy)
+		inline Dictionary(Dictionary &&other) noexcept : ds(other.ds), isTemp(false) { if (other.isTemp) retain(); else other.ds = nullptr; }
+		Dictionary& operator=(Dictionary &&other) noexcept {
+			if (other.isTemp or this == &other) return *this = (const Dictionary&)other;
+			DictionaryStorage<K, V> *storage = other.ds;
+			other.ds = nullptr;
+			release();
+			ds = storage;
+			isTemp = false;
+			return *this;
+		}
 		
 		/// OPERATIONS
-		inline void SetValue(const K& key, const V& value);
+		inline void SetValue(const K& key, V value);
 		inline bool Remove(const K& key, V *output = nullptr);
 		inline void RemoveAll();
 		
+		// Drop our reference to the storage, leaving us empty, without clearing
+		// it (as other dictionaries, e.g. closures, may still refer to it).
+		void Detach() { release(); ds = nullptr; isTemp = false; }
+		
 		/// ACCESS
 		inline V Lookup(const K& key, const V& defaultValue) const;
 		inline const V operator[](const K& key) const;
 		inline bool Get(const K& key, V *outValue) const;
+		
+		// Get a pointer to the value stored under the given key, or nullptr if
+		// not found.  The pointer remains valid as long as Epoch() is unchanged.
+		inline V* GetValuePointer(const K& key) const;
+		
+		// Get a number that identifies both this dictionary's storage and its
+		// set of keys: it changes whenever a key is added or removed (but not
+		// when the value of an existing key is changed), and is never shared
+		// by two different storages.  Useful for validating cached lookups.
+		unsigned long long Epoch() const { return ds ? ds->epoch : 0; }
 
 		/// INQUIRY
 		long Count() const { return ds ? ds->mSize : 0; }
@@ -128,13 +594,37 @@ namespace MiniScript {
 		inline List<V> Values() const;
 		inline bool empty() const { return Count() == 0; }
 		
+		/// POSITIONAL ACCESS
+		// Get the key or value at the given position (0 to Count()-1), in the order
+		// in which the keys were added.  This takes constant time, except when
+		// there are holes left by removing keys (other than the first or last
+		// ones), which must first be squeezed out (changing the Epoch).
+		inline K KeyAt(long position) const;
+		inline V ValueAt(long position) const;
+		
+		// Get the position of the given key, or -1 if not found; and get a pointer
+		// to the value at a given position (valid as long as Epoch() is unchanged).
+		inline long IndexOf(const K& key) const;
+		inline V* ValuePointerAt(long position) const;
+		
+		/// SHAPES
+		// Make this (empty) dictionary share its keys with all others started from
+		// the same owner, for as long as they add the same keys in the same order.
+		// Each then stores only its own values.  This is otherwise invisible.
+		void StartShape(const Dictionary& owner) { ensureStorage(); ((Dictionary&)owner).ensureStorage(); ds->StartShape(owner.ds); }
+		
+		// Get a number identifying this dictionary's shape, or 0 if it has none.
+		// Dictionaries with the same (nonzero) shape have the same keys, in the
+		// same order, so a given key is at the same position in each.
+		unsigned long long ShapeId() const { return ds and ds->mShape ? ds->mShape->id : 0; }
+		
 		/// ITERATION
 		DictIterator<K,V> GetIterator() const { return DictIterator<K,V>(ds); }
 		
 		/// ASSIGNMENT OVERRIDE
 		typedef bool (*AssignOverrideCallback)(Dictionary<K,V,HASH> &dict, K key, V value);
 		void SetAssignOverride(AssignOverrideCallback callback) { ensureStorage(); ds->assignOverride = (void*)callback; }
-		bool ApplyAssignOverride(K key, V value) {
+		bool ApplyAssignOverride(const K& key, const V& value) {
 			if (ds == nullptr or ds->assignOverride == nullptr) return false;
 			AssignOverrideCallback cb = (AssignOverrideCallback)(ds->assignOverride);
 			return cb(*this, key, value);
@@ -143,14 +633,16 @@ namespace MiniScript {
 		/// LOOKUP OVERRIDE
 		typedef bool (*EvalOverrideCallback)(Dictionary<K,V,HASH> &dict, K key, V& outValue);
 		void SetEvalOverride(EvalOverrideCallback callback) { ensureStorage(); ds->evalOverride = (void*)callback; }
-		bool ApplyEvalOverride(K key, V& outValue) {
+		bool ApplyEvalOverride(const K& key, V& outValue) {
 			if (ds == nullptr or ds->evalOverride == nullptr) return false;
 			EvalOverrideCallback cb = (EvalOverrideCallback)(ds->evalOverride);
 			return cb(*this, key, outValue);
 		}
 		
 		/// DEBUGGING
-		inline int BinEntries(int binNum) const;
+		long Capacity() const { return ds ? ds->mEntryCapacity : 0; }	// (entries there is room for)
+		bool IsHashed() const { return ds and ds->mSlots; }		// (false while small enough to just scan)
+		inline int MaxProbeDistance() const;	// (longest probe sequence, counting the slot found; 0 if not hashed)
 		
 	protected:
 		Dictionary(DictionaryStorage<K, V>* storage, bool temp=true) : ds(storage), isTemp(temp) { retain(); }
@@ -158,7 +650,7 @@ namespace MiniScript {
 	private:
 		friend class Value;
 		
-		inline int hashKey(const K& key) const;
+		inline unsigned int hashKey(const K& key) const;
 
 		
 		void forget() { ds = nullptr; }
@@ -170,57 +662,26 @@ namespace MiniScript {
 };
 
 
+
+
 	#pragma mark -
 	#pragma mark Inline Method Implementation
 
 	#pragma mark LIFECYCLE
 
 	template <class K, class V, unsigned int HASH(const K&)>
-	void Dictionary<K, V, HASH>::SetValue(const K& key, const V& value) {
-		int hash = hashKey(key);
+	void Dictionary<K, V, HASH>::SetValue(const K& key, V value) {
+		unsigned int hash = hashKey(key);
 		ensureStorage();
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		while (entry) {
-			// Note: We rely here on our key types defining == in a way
-			// that is intended to equate keys that should be unique in
-			// the dictionary (and consistent with the hash function).
-			if (entry->key == key) {
-				entry->value = value;
-				return;
-			}
-			entry = entry->next;
-		}
-		
-		// A KeyValuePair does not exist yet so make a new one
-		entry = new HashMapEntry<K, V>();
-		entry->key = key;
-		entry->value = value;
-		entry->next = ds->mTable[hash];
-		ds->mTable[hash] = entry;
-
-		ds->mSize++;
+		long i = ds->Find(key, hash);
+		if (i >= 0) ds->mValues[i] = std::move(value);
+		else ds->Insert(key, std::move(value), hash);
 	}
 	
 	template <class K, class V, unsigned int HASH(const K&)>
 	bool Dictionary<K, V, HASH>::Remove(const K& key, V *output) {
 		if (!ds) return false;
-		int hash = hashKey(key);
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		HashMapEntry<K, V> *prev = nullptr;
-		while (entry) {
-			if (entry->key == key) {
-				if (prev) prev->next = entry->next;
-				else ds->mTable[hash] = entry->next;
-				entry->next = nullptr;
-				delete entry;
-				ds->mSize--;
-				return true;
-			}
-			prev = entry;
-			entry = entry->next;
-		}
-
-		return false;
+		return ds->Remove(key, hashKey(key), output);
 	}
 
 	template <class K, class V, unsigned int HASH(const K&)>
@@ -231,41 +692,33 @@ namespace MiniScript {
 	template <class K, class V, unsigned int HASH(const K&)>
 	V Dictionary<K, V, HASH>::Lookup(const K& key, const V& defaultValue) const {
 		if (!ds) return defaultValue;
-		int hash = hashKey(key);
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		while (entry) {
-			if (entry->key == key) return entry->value;
-			entry = entry->next;
-		}
-		
-		return defaultValue;
+		long i = ds->Find(key, hashKey(key));
+		if (i < 0) return defaultValue;
+		return ds->mValues[i];
 	}
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	bool Dictionary<K, V, HASH>::Get(const K& key, V *outValue) const {
 		if (!ds) return false;
-		int hash = hashKey(key);
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		while (entry) {
-			if (entry->key == key) {
-				*outValue = entry->value;
-				return true;
-			}
-			entry = entry->next;
-		}
-		
-		return false;
+		long i = ds->Find(key, hashKey(key));
+		if (i < 0) return false;
+		*outValue = ds->mValues[i];
+		return true;
+	}
+
+	template <class K, class V, unsigned int HASH(const K&)>
+	V* Dictionary<K, V, HASH>::GetValuePointer(const K& key) const {
+		if (!ds) return nullptr;
+		long i = ds->Find(key, hashKey(key));
+		if (i < 0) return nullptr;
+		return &ds->mValues[i];
 	}
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	const V Dictionary<K, V, HASH>::operator[](const K& key) const {
 		Assert(ds);
-		int hash = hashKey(key);
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		while (entry) {
-			if (entry->key == key) return entry->value;
-			entry = entry->next;
-		}
+		long i = ds->Find(key, hashKey(key));
+		if (i >= 0) return ds->mValues[i];
 		Error("Dictionary key not found");
 		return V();
 	}
@@ -277,15 +730,11 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	List<K> Dictionary<K, V, HASH>::Keys() const {
-		List<K> keys;
+		List<K> keys(Count());
 		if (!ds) return keys;
 		
-		for (int i=0; i<TABLE_SIZE; i++) {
-			HashMapEntry<K, V> *entry = ds->mTable[i];
-			while (entry) {
-				keys.Add(entry->key);
-				entry = entry->next;
-			}
+		for (long i=ds->mFirst; i<ds->mUsed; i++) {
+			if (!ds->mKeys[i].removed) keys.Add(ds->mKeys[i].key);
 		}
 		
 		return keys;
@@ -293,86 +742,74 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	List<V> Dictionary<K, V, HASH>::Values() const {
-		List<K> values;
+		List<V> values(Count());
 		if (!ds) return values;
 		
-		for (int i=0; i<TABLE_SIZE; i++) {
-			HashMapEntry<K, V> *entry = ds->mTable[i];
-			while (entry) {
-				values.Add(entry->value);
-				entry = entry->next;
-			}
+		for (long i=ds->mFirst; i<ds->mUsed; i++) {
+			if (!ds->mKeys[i].removed) values.Add(ds->mValues[i]);
 		}
 		
 		return values;
 	}
 
 	template <class K, class V, unsigned int HASH(const K&)>
-	bool Dictionary<K, V, HASH>::ContainsKey(const K& key) const {
-		if (!ds) return false;
-		int hash = hashKey(key);
-		HashMapEntry<K, V> *entry = ds->mTable[hash];
-		while (entry) {
-			if (entry->key == key) return true;
-			entry = entry->next;
-		}
+	K Dictionary<K, V, HASH>::KeyAt(long position) const {
+		Assert(position >= 0 and position < Count());
+		long i = ds->EntryIndex(position);	// (may reallocate the entries)
+		return ds->mKeys[i].key;
+	}
 
-		return false;
+	template <class K, class V, unsigned int HASH(const K&)>
+	V Dictionary<K, V, HASH>::ValueAt(long position) const {
+		Assert(position >= 0 and position < Count());
+		long i = ds->EntryIndex(position);	// (may reallocate the entries)
+		return ds->mValues[i];
 	}
-	
+
 	template <class K, class V, unsigned int HASH(const K&)>
-	int Dictionary<K, V, HASH>::BinEntries(int binNum) const {
-		if (!ds) return 0;
-		int count = 0;
-		HashMapEntry<K, V> *entry = ds->mTable[binNum];
-		while (entry) {
-			count++;
-			entry = entry->next;
+	long Dictionary<K, V, HASH>::IndexOf(const K& key) const {
+		if (!ds) return -1;
+		unsigned int hash = hashKey(key);
+		long i = ds->Find(key, hash);
+		if (i < 0) return -1;
+		if (ds->mUsed - ds->mFirst != ds->mSize) {
+			ds->Resize(ds->mEntryCapacity);		// (squeeze out holes, so position == index)
+			i = ds->Find(key, hash);
 		}
-		return count;
+		return i - ds->mFirst;
 	}
 
-	#pragma mark -
-	#pragma mark Private
-
 	template <class K, class V, unsigned int HASH(const K&)>
-	int Dictionary<K, V, HASH>::hashKey(const K& key) const {
-		unsigned int hash = ((unsigned int)HASH(key)) % TABLE_SIZE;
-		return hash;
+	V* Dictionary<K, V, HASH>::ValuePointerAt(long position) const {
+		Assert(position >= 0 and position < Count());
+		long i = ds->EntryIndex(position);	// (may reallocate the entries)
+		return &ds->mValues[i];
 	}
 
-	// DictIterator methods:
+	template <class K, class V, unsigned int HASH(const K&)>
+	bool Dictionary<K, V, HASH>::ContainsKey(const K& key) const {
+		if (!ds) return false;
+		return ds->Find(key, hashKey(key)) >= 0;
+	}
 	
-	template <class K, class V>
-	DictIterator<K, V>::DictIterator(DictionaryStorage<K, V> *storage) : storage(storage), binIndex(0) {
-		// Find and attach to the first bin with any data in it.
-		if (storage) {
-			for (int i=0; i<TABLE_SIZE; i++) {
-				if (storage->mTable[i]) {
-					binIndex = i;
-					entry = storage->mTable[i];
-					return;
-				}
-			}
+	template <class K, class V, unsigned int HASH(const K&)>
+	int Dictionary<K, V, HASH>::MaxProbeDistance() const {
+		int result = 0;
+		if (!ds) return result;
+		for (long i=0; i<ds->mCapacity; i++) {
+			if (ds->mSlots[i].entry and (int)ds->DistanceAt(i) + 1 > result) result = (int)ds->DistanceAt(i) + 1;
 		}
-		entry = nullptr;	// (dictionary is empty)
+		return result;
 	}
 
-	template <class K, class V>
-	void DictIterator<K, V>::Next() {
-		entry = entry->next;
-		if (!entry) {
-			// Advance to the next bin with any data in it.
-			while (binIndex+1 < TABLE_SIZE) {
-				binIndex++;
-				entry = storage->mTable[binIndex];
-				if (entry) return;
-			}
-		}
-	}
+	#pragma mark -
+	#pragma mark Private
 
+	template <class K, class V, unsigned int HASH(const K&)>
+	unsigned int Dictionary<K, V, HASH>::hashKey(const K& key) const {
+		return (unsigned int)HASH(key);
+	}
 
-	
 	// Some hash methods convenient for use with Dictionary:
 	
 	inline unsigned int hashUInt(const unsigned int &xin) {
@@ -108,6 +108,15 @@ namespace MiniScript {
 		Assert(list2.IndexOf(42) == 0);
 		Assert(list2.Contains(42));
 		
+		// Moving a list hands over its reference, leaving the original empty.
+		List<int> listCopy = list2;
+		List<int> moved(std::move(listCopy));
+		Assert(listCopy.Count() == 0);
+		check(moved, 42, 1, 0);
+		moved.Add(7);
+		Assert(list2.Count() == 4);	// (moved still shares list2's storage)
+		moved.Pop();
+		
 		Assert(list2.IndexOf(0) == 2);
 		Assert(list2.Contains(0));
 		
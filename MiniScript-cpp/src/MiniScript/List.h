@@ -15,11 +15,25 @@
 // ToDo: merge that into here, and SimpleVector goes away.
 #include "SimpleVector.h"
 #include "RefCountedStorage.h"
+#include "CycleCollector.h"
 
 namespace MiniScript {
 	
+	// The base class of a list's storage.  Lists that can hold lists (i.e. of
+	// Value) specialize this to be CollectableStorage; see MiniscriptTypes.h.
 	template <class T>
-	class ListStorage : public RefCountedStorage, public SimpleVector<T> {
+	struct ListStorageBase { typedef RefCountedStorage Type; };
+
+	template <class T>
+	class ListStorage : public ListStorageBase<T>::Type, public SimpleVector<T> {
+	public:
+		// cycle collection support (used only when our base is CollectableStorage)
+		void VisitChildren(CollectableStorage::Visitor visit, void *data) {
+			for (long i=0; i<(long)this->size(); i++) VisitCollectable((*this)[i], visit, data);
+		}
+		void ClearChildren() { this->deleteAll(); }
+		CollectableStorage::Kind CollectableKind() const { return CollectableStorage::Kind::List; }
+
 	private:
 		ListStorage() {}
 		ListStorage(long slots) : SimpleVector<T>(slots) {}
@@ -34,7 +48,20 @@ namespace MiniScript {
 		// constructors and assignment-op
 		List(long sizeHint=0) : ls(nullptr), isTemp(false) { if (sizeHint) ls = new ListStorage<T>(sizeHint); }
 		List(const List& other) : isTemp(false) { ((List&)other).ensureStorage(); ls = other.ls; retain(); }
-		List& operator= (const List& other) { ((List&)other).ensureStorage(); other.ls->refCount++; release(); ls = other.ls; isTemp = false; return *this; }
+		List& operator= (const List& other) { ((List&)other).ensureStorage(); other.ls->retain(); release(); ls = other.ls; isTemp = false; return *this; }
+		
+		// move constructor and assignment-op: take over the other list's reference
+		// (unless it's a temp, which has none to give, in which case we copy)
+		List(List&& other) noexcept : ls(other.ls), isTemp(false) { if (other.isTemp) retain(); else other.ls = nullptr; }
+		List& operator= (List&& other) noexcept {
+			if (other.isTemp or this == &other) return *this = (const List&)other;
+			ListStorage<T> *storage = other.ls;
+			other.ls = nullptr;
+			release();
+			ls = storage;
+			isTemp = false;
+			return *this;
+		}
 
 		// inspectors
 		long Count() const { return ls ? ls->size() : 0; }
@@ -43,9 +70,9 @@ namespace MiniScript {
 		T& Last() const { Assert(ls); return ls->peek_back(); }
 		
 		// mutators
-		void Add(T item) { ensureStorage(); ls->push_back(item); }
+		void Add(T item) { ensureStorage(); ls->push_back(std::move(item)); }
 		void Clear() { if (ls) ls->deleteAll(); }
-		void Insert(T item, long index) { ensureStorage(); ls->insert(item, index); }
+		void Insert(T item, long index) { ensureStorage(); ls->insert(std::move(item), index); }
 		void RemoveAt(long index) { if (ls) ls->deleteIdx(index); }
 		void RemoveRange(long startIndex, long count) { for (long i=0; i<count; i++) RemoveAt(startIndex); }	// OFI: do this without looping
 		void Reposition(long indexFrom, long indexTo) { if (ls) ls->reposition(indexFrom, indexTo); }
@@ -54,6 +81,7 @@ namespace MiniScript {
 		void Resize(long newLength) { if (newLength == 0) Clear(); else { ensureStorage(); ls->resize(newLength); } }
 		void Reverse() { if (ls) ls->reverse(); }
 		void EnsureStorage() { ensureStorage(); }	// (call before copying a reference, if you want both to refer to same object)
+		void Detach() { release(); ls = nullptr; isTemp = false; }	// drop our reference (without clearing a shared list), leaving us empty
 		
 		// array-like access (both read and write)
 		inline T& operator[](const long idx) { Assert(ls); return (*ls)[idx]; }
@@ -72,8 +100,8 @@ namespace MiniScript {
 		List(ListStorage<T>* storage, bool temp=true) : ls(storage), isTemp(temp) { retain(); }
 		void forget() { ls = nullptr; }
 		
-		void retain() { if (ls and !isTemp) ls->refCount++; }
-		void release() { if (ls and !isTemp and --(ls->refCount) == 0) { delete ls; ls = nullptr; } }
+		void retain() { if (ls and !isTemp) ls->retain(); }
+		void release() { if (ls and !isTemp) { ls->release(); ls = nullptr; } }
 		void ensureStorage() { if (!ls) ls = new ListStorage<T>(); }
 		ListStorage<T> *ls;
 		bool isTemp;	// indicates temp wrapper which does not participate in ref counting
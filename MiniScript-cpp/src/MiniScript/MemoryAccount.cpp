@@ -0,0 +1,73 @@
+//
+//  MemoryAccount.cpp
+//  MiniScript
+//
+
+#include "MemoryAccount.h"
+#include "MiniscriptErrors.h"
+#include "MiniscriptTypes.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	thread_local MemoryAccount *MemoryAccount::current = nullptr;
+
+	void MemoryAccount::Exceeded() {
+		enforcing = false;		// (so we can report this, and unwind, without failing again)
+		LimitExceededException("memory limit exceeded").raise();
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+	//--------------------------------------------------------------------------------
+
+	class TestMemoryAccount : public UnitTest
+	{
+	public:
+		TestMemoryAccount() : UnitTest("MemoryAccount") {}
+		virtual void Run();
+	};
+
+	void TestMemoryAccount::Run() {
+		MemoryAccount account;
+
+		// Memory made and freed while the account is current is charged and credited.
+		{
+			MemoryAccount::Scope scope(account, false);
+			ValueList list;
+			for (int i=0; i<100; i++) list.Add(i);
+			Assert(account.LiveBytes() >= 100 * (long)sizeof(Value));
+			long peak = account.PeakBytes();
+			Assert(peak >= account.LiveBytes());
+			list.Clear();
+			Assert(account.LiveBytes() < peak);
+		}
+		Assert(account.LiveBytes() == 0);
+		Assert(account.PeakBytes() >= 100 * (long)sizeof(Value));
+
+		// ...but not while it isn't.
+		ValueList other;
+		other.Add(42);
+		Assert(account.LiveBytes() == 0);
+
+		// Going over the limit raises an exception (once), and leaves us unchanged.
+		account.limit = 1000;
+		{
+			MemoryAccount::Scope scope(account, true);
+			ValueList list;
+			bool raised = false;
+			try {
+				for (int i=0; i<1000; i++) list.Add(i);
+			} catch (const LimitExceededException&) {
+				raised = true;
+			}
+			Assert(raised);
+			Assert(list.Count() < 1000 and account.LiveBytes() <= account.limit);
+			list.Add(String("no longer enforced, while we deal with that"));
+		}
+		Assert(account.LiveBytes() == 0);
+	}
+
+	RegisterUnitTest(TestMemoryAccount);
+
+}
@@ -0,0 +1,131 @@
+//
+//  MemoryAccount.h
+//  MiniScript
+//
+//	Keeps track of how much memory an interpreter is using -- that is, the
+//	memory for strings, lists, maps, functions, and so on (including their
+//	element arrays) -- and optionally limits it.
+//
+//	Each thread has at most one current account, normally that of the
+//	Interpreter running on it (see MemoryAccount::Scope).  Allocations made
+//	while an account is current are charged to it, and memory freed while it
+//	is current is credited back.  So memory that one interpreter makes and
+//	another frees (which can only happen if the host passes values between
+//	them) is credited to the wrong one; and memory made with no account
+//	current (e.g. by the host, or by static initializers) isn't counted.
+//
+
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+#include <ciso646>
+#include <stddef.h>
+#include <new>
+#include "MemoryPool.h"
+
+namespace MiniScript {
+
+	class MemoryAccount {
+	public:
+		MemoryAccount() : limit(0), liveBytes(0), peakBytes(0), enforcing(false) {}
+
+		// Most bytes that may be in use at once, or 0 for no limit.  An allocation
+		// that would go over this raises a LimitExceededException (but only while
+		// a script is running or being compiled; see Scope).
+		long limit;
+
+		// Bytes currently in use, and the most that have been in use at once.
+		long LiveBytes() const { return liveBytes; }
+		long PeakBytes() const { return peakBytes; }
+		void ResetPeak() { peakBytes = liveBytes; }
+
+		// Charge the current account (if any) for an allocation, or credit it for a free.
+		static void Charge(size_t bytes) { if (current) current->Add((long)bytes); }
+		static void Credit(size_t bytes) { if (current) current->liveBytes -= (long)bytes; }
+
+		/// <summary>
+		/// Scope: makes the given account current on this thread, for as long
+		/// as the scope exists.  If enforce is true, the account's limit is
+		/// enforced in that time (until it is first exceeded; so that reporting
+		/// the error, for example, doesn't fail too).
+		/// </summary>
+		class Scope {
+		public:
+			Scope(MemoryAccount& account, bool enforce) : account(account),
+				prevCurrent(current), prevEnforcing(account.enforcing) {
+				current = &account;
+				account.enforcing = enforce;
+			}
+			~Scope() {
+				account.enforcing = prevEnforcing;
+				current = prevCurrent;
+			}
+		private:
+			MemoryAccount& account;
+			MemoryAccount *prevCurrent;
+			bool prevEnforcing;
+		};
+
+		/// <summary>
+		/// Unaccounted: makes no account current on this thread, for as long as
+		/// it exists.  Use this when making things that are shared by all
+		/// interpreters (and so shouldn't be charged to, or limited by, any one).
+		/// </summary>
+		class Unaccounted {
+		public:
+			Unaccounted() : prevCurrent(current) { current = nullptr; }
+			~Unaccounted() { current = prevCurrent; }
+		private:
+			MemoryAccount *prevCurrent;
+		};
+
+		// Make an array of count items (default-initialized, like new[]),
+		// charged to the current account.
+		template <class T>
+		static T* NewArray(size_t count) {
+			size_t bytes = sizeof(ArrayHeader) + count * sizeof(T);
+			Charge(bytes);
+			ArrayHeader *header = static_cast<ArrayHeader*>(MemoryPool::Allocate(bytes));
+			header->count = count;
+			T *items = reinterpret_cast<T*>(header + 1);
+			for (size_t i=0; i<count; i++) ::new(items + i) T;
+			return items;
+		}
+
+		// Destroy and free an array from NewArray (which may be nullptr).
+		template <class T>
+		static void DeleteArray(T *items) {
+			if (not items) return;
+			ArrayHeader *header = reinterpret_cast<ArrayHeader*>(items) - 1;
+			size_t count = header->count;
+			for (size_t i=count; i>0; i--) items[i-1].~T();
+			size_t bytes = sizeof(ArrayHeader) + count * sizeof(T);
+			Credit(bytes);
+			MemoryPool::Free(header, bytes);
+		}
+
+	private:
+		void Add(long bytes) {
+			long newLive = liveBytes + bytes;
+			if (limit > 0 and newLive > limit and enforcing) Exceeded();
+			liveBytes = newLive;
+			if (newLive > peakBytes) peakBytes = newLive;
+		}
+		void Exceeded();	// (raises LimitExceededException)
+
+		// What precedes the items of an array (padded to keep them aligned).
+		struct ArrayHeader {
+			size_t count;
+			size_t reserved;
+		};
+
+		long liveBytes;
+		long peakBytes;
+		bool enforcing;
+
+		static thread_local MemoryAccount *current;
+	};
+
+}
+
+#endif /* MEMORYACCOUNT_H */
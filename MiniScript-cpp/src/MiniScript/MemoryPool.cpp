@@ -0,0 +1,100 @@
+//
+//  MemoryPool.cpp
+//  MiniScript
+//
+
+#include "MemoryPool.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	thread_local MemoryPool::State MemoryPool::state;
+
+	// When a thread exits, give back its free blocks, and keep no more after that
+	// (as storage may still be freed by the destructors of later statics).
+	MemoryPool::Closer::~Closer() {
+		Trim();
+		state.closed = true;
+	}
+
+	bool MemoryPool::OpenForThread() {
+		static thread_local Closer closer;		// (made the first time we get here on each thread)
+		state.opened = true;
+		return true;
+	}
+
+	void MemoryPool::Trim() {
+		for (int c=0; c<classCount; c++) {
+			while (state.freeList[c]) {
+				FreeBlock *block = state.freeList[c];
+				state.freeList[c] = block->next;
+				::operator delete(block);
+				state.released++;
+			}
+			state.freeCount[c] = 0;
+		}
+	}
+
+	MemoryPool::Stats MemoryPool::GetStats() {
+		Stats stats;
+		stats.allocations = state.allocations;
+		stats.reused = state.reused;
+		stats.frees = state.frees;
+		stats.released = state.released;
+		stats.cachedBlocks = stats.cachedBytes = 0;
+		for (int c=0; c<classCount; c++) {
+			stats.cachedBlocks += state.freeCount[c];
+			stats.cachedBytes += state.freeCount[c] * BlockSize(c);
+		}
+		return stats;
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+	//--------------------------------------------------------------------------------
+
+	class TestMemoryPool : public UnitTest
+	{
+	public:
+		TestMemoryPool() : UnitTest("MemoryPool") {}
+		virtual void Run();
+	};
+
+	void TestMemoryPool::Run() {
+		Assert(MemoryPool::GoodSize(MemoryPool::maxPooledSize + 1) == MemoryPool::maxPooledSize + 1);
+
+#if MINISCRIPT_POOL_ALLOCATOR
+		Assert(MemoryPool::GoodSize(1) == 16);
+		Assert(MemoryPool::GoodSize(16) == 16);
+		Assert(MemoryPool::GoodSize(17) == 32);
+
+		MemoryPool::Trim();
+		MemoryPool::Stats before = MemoryPool::GetStats();
+		Assert(before.cachedBlocks == 0 and before.cachedBytes == 0);
+
+		// A freed block is handed out again for the next request of its size class.
+		void *a = MemoryPool::Allocate(40);
+		MemoryPool::Free(a, 40);
+		void *b = MemoryPool::Allocate(48);
+		Assert(b == a);
+		MemoryPool::Free(b, 48);
+
+		// Large blocks aren't pooled (or counted).
+		void *big = MemoryPool::Allocate(MemoryPool::maxPooledSize * 2);
+		MemoryPool::Free(big, MemoryPool::maxPooledSize * 2);
+
+		MemoryPool::Stats after = MemoryPool::GetStats();
+		Assert(after.allocations - before.allocations == 2);
+		Assert(after.reused - before.reused == 1);
+		Assert(after.frees - before.frees == 2);
+		Assert(after.cachedBlocks == 1 and after.cachedBytes == 48);
+
+		MemoryPool::Trim();
+		Assert(MemoryPool::GetStats().cachedBlocks == 0);
+		Assert(MemoryPool::GetStats().released - after.released == 1);
+#endif
+	}
+
+	RegisterUnitTest(TestMemoryPool);
+
+}
@@ -0,0 +1,132 @@
+//
+//  MemoryPool.h
+//  MiniScript
+//
+//	A simple size-class allocator for the small, fixed-size objects we make
+//	and free constantly: string, list, map and function storage, and so on.
+//	Freed blocks are kept on a free list per size class (and per thread), and
+//	handed out again for the next object of that class, so that most of these
+//	never reach malloc at all -- nor contend with other threads for its locks.
+//
+//	Each thread keeps at most a modest number of free blocks of each size;
+//	any beyond that, and any larger allocations, go straight back to the
+//	system.  Trim releases all of a thread's free blocks at once (as happens
+//	when an Interpreter is destroyed).
+//
+//	Define MINISCRIPT_POOL_ALLOCATOR as 0 to use plain new/delete instead
+//	(e.g. when hunting memory errors with a tool that needs to see every free).
+//
+
+#ifndef MEMORYPOOL_H
+#define MEMORYPOOL_H
+
+#include <stddef.h>
+#include <new>
+
+#ifndef MINISCRIPT_POOL_ALLOCATOR
+	#define MINISCRIPT_POOL_ALLOCATOR 1
+#endif
+
+namespace MiniScript {
+
+	class MemoryPool {
+	public:
+		// Allocator statistics (for the calling thread).
+		struct Stats {
+			long allocations;	// blocks allocated (of a pooled size)
+			long reused;		// ...of which were served from a free list
+			long frees;			// blocks freed (of a pooled size)
+			long released;		// free blocks given back to the system by Trim
+			long cachedBlocks;	// blocks currently on our free lists
+			long cachedBytes;	// ...and how many bytes those take up
+		};
+
+		// Blocks come in multiples of this size, up to classCount of them.
+		static const size_t granularity = 16;
+		static const int classCount = 32;
+		static const size_t maxPooledSize = granularity * classCount;
+
+		// Keep at most this many bytes of free blocks of any one size.
+		static const size_t maxCachedBytesPerClass = 64 * 1024;
+
+		// Get memory for an object of the given size.
+		static void *Allocate(size_t size) {
+#if MINISCRIPT_POOL_ALLOCATOR
+			if (size <= maxPooledSize) {
+				int c = ClassOf(size);
+				state.allocations++;
+				FreeBlock *block = state.freeList[c];
+				if (block) {
+					state.freeList[c] = block->next;
+					state.freeCount[c]--;
+					state.reused++;
+					return block;
+				}
+				return ::operator new(BlockSize(c));
+			}
+#endif
+			return ::operator new(size);
+		}
+
+		// Free memory from Allocate (given the same size it was allocated with).
+		static void Free(void *p, size_t size) {
+#if MINISCRIPT_POOL_ALLOCATOR
+			if (p and size <= maxPooledSize) {
+				int c = ClassOf(size);
+				state.frees++;
+				if (state.freeCount[c] < maxCachedBytesPerClass / BlockSize(c) and Open()) {
+					FreeBlock *block = static_cast<FreeBlock*>(p);
+					block->next = state.freeList[c];
+					state.freeList[c] = block;
+					state.freeCount[c]++;
+					return;
+				}
+			}
+#endif
+			::operator delete(p);
+		}
+
+		// Return the number of bytes actually given for a request of the given
+		// size (so the caller may make use of any extra).
+		static size_t GoodSize(size_t size) {
+#if MINISCRIPT_POOL_ALLOCATOR
+			if (size > 0 and size <= maxPooledSize) return BlockSize(ClassOf(size));
+#endif
+			return size;
+		}
+
+		// Give all of this thread's free blocks back to the system.
+		static void Trim();
+
+		// Get the statistics for this thread.
+		static Stats GetStats();
+
+	private:
+		struct FreeBlock {
+			FreeBlock *next;
+		};
+
+		// (Kept trivial, so it's usable from any static constructor or destructor.)
+		struct State {
+			FreeBlock *freeList[classCount];
+			size_t freeCount[classCount];
+			long allocations;
+			long reused;
+			long frees;
+			long released;
+			bool opened;	// true once we've arranged to be trimmed at thread exit
+			bool closed;	// true once we have been (so keep nothing more)
+		};
+		static thread_local State state;
+
+		static int ClassOf(size_t size) { return (int)((size - 1) / granularity); }
+		static size_t BlockSize(int sizeClass) { return (sizeClass + 1) * granularity; }
+
+		static bool Open() { return state.opened ? not state.closed : OpenForThread(); }
+		static bool OpenForThread();
+		struct Closer { ~Closer(); };
+	};
+
+}
+
+#endif /* MEMORYPOOL_H */
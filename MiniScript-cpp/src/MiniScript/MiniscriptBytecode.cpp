@@ -0,0 +1,607 @@
+//
+//  MiniscriptBytecode.cpp
+//  MiniScript
+//
+//	Lowering of TAC into the compact Bytecode form executed by the Machine.
+//
+
+#include "MiniscriptBytecode.h"
+#include "MiniscriptOptimizer.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	Bytecode::~Bytecode() {
+		delete[] code;
+		delete[] constants;
+		delete[] names;
+		delete[] dotSites;
+		delete[] slotNames;
+		delete[] paramSlots;
+		delete[] sequenceTemps;
+		delete[] locIndex;
+	}
+
+	// Return whether the given operand refers to the 'locals' map, anywhere
+	// within it (e.g. as part of a dot chain or list literal).
+	static bool ReferencesLocals(Value v) {
+		switch (v.type) {
+			case ValueType::Var:
+				return v.GetString() == "locals";
+			case ValueType::SeqElem:
+			{
+				SeqElemStorage *seqElem = (SeqElemStorage*)(v.data.ref);
+				return ReferencesLocals(seqElem->sequence) or ReferencesLocals(seqElem->index);
+			}
+			case ValueType::List:
+			{
+				ValueList list = v.GetList();
+				for (long i=0, count=list.Count(); i<count; i++) {
+					if (ReferencesLocals(list[i])) return true;
+				}
+				return false;
+			}
+			case ValueType::Map:
+			{
+				ValueDict map = v.GetDict();
+				for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+					if (ReferencesLocals(kv.Key()) or ReferencesLocals(kv.Value())) return true;
+				}
+				return false;
+			}
+			default:
+				return false;
+		}
+	}
+	
+	// Return whether the local variables of a function with the given code can
+	// live in frame slots.  They can't if the code needs them as a real map,
+	// either by using 'locals', or by defining an inner function (which
+	// captures this frame's variables as its outer scope).
+	static bool CanUseSlots(List<TACLine>& tac) {
+		bool anyVars = false;
+		for (long i=0, count=tac.Count(); i<count; i++) {
+			TACLine& line = tac[i];
+			if (line.op == TACLine::Op::BindAssignA) return false;
+			if (ReferencesLocals(line.lhs) or ReferencesLocals(line.rhsA) or ReferencesLocals(line.rhsB)) return false;
+			if (line.lhs.type == ValueType::Var or line.rhsA.type == ValueType::Var
+				or line.rhsB.type == ValueType::Var) anyVars = true;
+		}
+		return anyVars;		// (no point, e.g. for intrinsic wrappers, which reference no variables)
+	}
+	
+	// Return whether the given identifier may be assigned a frame slot.
+	static bool IsSlottable(const String& name) {
+		return name != "locals" and name != "globals" and name != "outer";
+	}
+
+	// Helper class used while lowering: accumulates the constant pool and
+	// name table, and classifies each operand.
+	class BytecodeBuilder {
+	public:
+		List<Value> constants;
+		List<NameRef> names;
+		List<DotSite> dotSites;
+		Dictionary<String, int, hashString> nameIndex;	// (for names with LocalOnlyMode::Off only)
+		Dictionary<String, int, hashString> slots;		// slot of each local variable
+		List<String> slotNames;
+		int tempCount;		// one more than the highest temp number seen
+		
+		BytecodeBuilder() : tempCount(1) {}	// (temp 0, the return value, is always needed)
+		
+		int AddSlot(const String& name) {
+			int result;
+			if (slots.Get(name, &result)) return result;
+			result = (int)slotNames.Count();
+			slotNames.Add(name);
+			slots.SetValue(name, result);
+			return result;
+		}
+
+		OperandKind Encode(const Value& v, int *outIndex) {
+			switch (v.type) {
+				case ValueType::Null:
+					*outIndex = 0;
+					return OperandKind::None;
+				case ValueType::Temp:
+					*outIndex = v.data.tempNum;
+					if (v.data.tempNum >= tempCount) tempCount = v.data.tempNum + 1;
+					return OperandKind::Temp;
+				case ValueType::Var:
+					*outIndex = NameIndex(v);
+					return names[*outIndex].slot < 0 ? OperandKind::Var : OperandKind::Local;
+				case ValueType::SeqElem:
+				{
+					SeqElemStorage *seqElem = (SeqElemStorage*)(v.data.ref);
+					if (seqElem != nullptr and seqElem->index.type == ValueType::String) {
+						// Member lookup by name (a.b): make a dot site for it.
+						DotSite site;
+						site.seqElem = v;
+						site.key = seqElem->index;
+						site.seqKind = Encode(seqElem->sequence, &site.seq);
+						site.viaSuper = (seqElem->sequence.type == ValueType::Var and seqElem->sequence.GetString() == "super");
+						*outIndex = (int)dotSites.Count();
+						dotSites.Add(site);
+						return OperandKind::Dot;
+					}
+					*outIndex = (int)constants.Count();
+					constants.Add(v);
+					return OperandKind::Complex;
+				}
+				default:
+					*outIndex = (int)constants.Count();
+					constants.Add(v);
+					return OperandKind::Const;
+			}
+		}
+
+	private:
+		int NameIndex(const Value& v) {
+			String name = v.GetString();
+			int result;
+			if (v.localOnly == LocalOnlyMode::Off and nameIndex.Get(name, &result)) return result;
+			result = (int)names.Count();
+			int slot = -1;
+			if (not slots.Get(name, &slot)) slot = -1;
+			names.Add(NameRef(name, v.localOnly, slot));
+			if (v.localOnly == LocalOnlyMode::Off) nameIndex.SetValue(name, result);
+			return result;
+		}
+	};
+
+	// Return the superinstruction for a comparison followed by a branch on its
+	// result, or Noop if the given op is not a comparison.
+	static TACLine::Op CompareAndBranchOp(TACLine::Op op) {
+		switch (op) {
+			case TACLine::Op::AEqualB:			return TACLine::Op::AEqualB_Branch;
+			case TACLine::Op::ANotEqualB:		return TACLine::Op::ANotEqualB_Branch;
+			case TACLine::Op::AGreaterThanB:	return TACLine::Op::AGreaterThanB_Branch;
+			case TACLine::Op::AGreatOrEqualB:	return TACLine::Op::AGreatOrEqualB_Branch;
+			case TACLine::Op::ALessThanB:		return TACLine::Op::ALessThanB_Branch;
+			case TACLine::Op::ALessOrEqualB:	return TACLine::Op::ALessOrEqualB_Branch;
+			default:							return TACLine::Op::Noop;
+		}
+	}
+
+	static inline bool SameOperand(OperandKind kind1, int index1, OperandKind kind2, int index2) {
+		return kind1 == kind2 and index1 == index2;
+	}
+
+	// Replace the first instruction of each common sequence with the equivalent
+	// superinstruction (see TACLine::Op), where it's safe to do so: nothing may
+	// jump into the middle of the sequence, and the temps that the sequence uses
+	// in passing must not be read anywhere else, since the superinstruction
+	// doesn't bother to store them.
+	static void FuseSuperinstructions(List<TACLine>& tac, Bytecode *bc) {
+		long count = bc->count;
+		if (count < 2) return;
+		Instruction *code = bc->code;
+		
+		bool *isJumpTarget = new bool[count];
+		for (long i=0; i<count; i++) isJumpTarget[i] = false;
+		List<int> tempReads;
+		for (long i=0; i<count; i++) {
+			TACLine& line = tac[i];
+			if ((line.op == TACLine::Op::GotoA or line.op == TACLine::Op::GotoAifB
+					or line.op == TACLine::Op::GotoAifTrulyB or line.op == TACLine::Op::GotoAifNotB)
+					and line.rhsA.type == ValueType::Number) {
+				long target = line.rhsA.IntValue();
+				if (target >= 0 and target < count) isJumpTarget[target] = true;
+			}
+			if (line.lhs.type != ValueType::Temp) Optimizer::CountTempReads(line.lhs, tempReads);
+			Optimizer::CountTempReads(line.rhsA, tempReads);
+			Optimizer::CountTempReads(line.rhsB, tempReads);
+		}
+		
+		// A branch on a constant line number, reading the given temp.
+		#define IS_BRANCH_ON(inst, op_, tempNum) ((inst).op == TACLine::Op::op_ \
+			and (inst).aKind == OperandKind::Const and bc->constants[(inst).a].type == ValueType::Number \
+			and (inst).bKind == OperandKind::Temp and (inst).b == (tempNum))
+		// A temp other than the return value, read only once (by the sequence).
+		#define IS_PASSING_TEMP(kind, tempNum) ((kind) == OperandKind::Temp and (tempNum) > 0 \
+			and (tempNum) < tempReads.Count() and tempReads[tempNum] == 1)
+		
+		for (long i=0; i+1<count; i++) {
+			Instruction& inst = code[i];
+			
+			// Comparison, then a branch on its result:
+			//	_t := a < b
+			//	goto X if not _t
+			TACLine::Op fusedOp = CompareAndBranchOp(inst.op);
+			if (fusedOp != TACLine::Op::Noop and not isJumpTarget[i+1]
+					and IS_PASSING_TEMP(inst.lhsKind, inst.lhs)
+					and (IS_BRANCH_ON(code[i+1], GotoAifB, inst.lhs) or IS_BRANCH_ON(code[i+1], GotoAifNotB, inst.lhs))) {
+				inst.op = fusedOp;
+				i++;
+				continue;
+			}
+			
+			// The step at the top of a 'for' loop, as emitted by the parser:
+			//	idx := idx + 1
+			//	_t1 := len(seq)
+			//	_t2 := idx >= _t1
+			//	goto END if _t2
+			//	var := seq iter idx
+			if (inst.op == TACLine::Op::APlusB and i+4 < count
+					and (inst.lhsKind == OperandKind::Var or inst.lhsKind == OperandKind::Local)
+					and SameOperand(inst.aKind, inst.a, inst.lhsKind, inst.lhs)
+					and inst.bKind == OperandKind::Const and bc->constants[inst.b] == Value::one
+					and not isJumpTarget[i+1] and not isJumpTarget[i+2]
+					and not isJumpTarget[i+3] and not isJumpTarget[i+4]) {
+				Instruction& lenInst = code[i+1];
+				Instruction& cmpInst = code[i+2];
+				Instruction& iterInst = code[i+4];
+				if (lenInst.op == TACLine::Op::LengthOfA and IS_PASSING_TEMP(lenInst.lhsKind, lenInst.lhs)
+						and (lenInst.aKind == OperandKind::Temp or lenInst.aKind == OperandKind::Var
+							 or lenInst.aKind == OperandKind::Local)
+						and cmpInst.op == TACLine::Op::AGreatOrEqualB and IS_PASSING_TEMP(cmpInst.lhsKind, cmpInst.lhs)
+						and cmpInst.lhs != lenInst.lhs
+						and SameOperand(cmpInst.aKind, cmpInst.a, inst.lhsKind, inst.lhs)
+						and SameOperand(cmpInst.bKind, cmpInst.b, lenInst.lhsKind, lenInst.lhs)
+						and IS_BRANCH_ON(code[i+3], GotoAifB, cmpInst.lhs)
+						and iterInst.op == TACLine::Op::ElemBofIterA
+						and SameOperand(iterInst.aKind, iterInst.a, lenInst.aKind, lenInst.a)
+						and SameOperand(iterInst.bKind, iterInst.b, inst.lhsKind, inst.lhs)) {
+					inst.op = TACLine::Op::ForNext;
+					i += 4;
+					continue;
+				}
+			}
+		}
+		
+		#undef IS_BRANCH_ON
+		#undef IS_PASSING_TEMP
+		delete[] isJumpTarget;
+	}
+
+	Bytecode* Bytecode::Lower(List<TACLine> tac, FunctionStorage *func) {
+		Bytecode *result = new Bytecode();
+		BytecodeBuilder builder;
+		long count = tac.Count();
+		result->count = count;
+		
+		// Assign frame slots to parameters first, then to anything else
+		// the function assigns to.
+		if (func != nullptr and CanUseSlots(tac)) {
+			long paramCount = func->parameters.Count();
+			if (paramCount > 0) result->paramSlots = new int[paramCount];
+			for (long i=0; i<paramCount; i++) {
+				result->paramSlots[i] = builder.AddSlot(func->parameters[i].name);
+			}
+			// The machine sets 'self' and 'super' on method calls; give them slots
+			// too, so that the variables map stays empty (see LookupCache).
+			result->selfSlot = builder.AddSlot("self");
+			result->superSlot = builder.AddSlot("super");
+			for (long i=0; i<count; i++) {
+				if (tac[i].lhs.type != ValueType::Var) continue;
+				String name = tac[i].lhs.GetString();
+				if (IsSlottable(name)) builder.AddSlot(name);
+			}
+		}
+		
+
+		if (count > 0) {
+			result->code = new Instruction[count];
+			result->locIndex = new int[count];
+		}
+		for (long i=0; i<count; i++) {
+			TACLine& line = tac[i];
+			Instruction& inst = result->code[i];
+			inst.op = line.op;
+			inst.lhsKind = builder.Encode(line.lhs, &inst.lhs);
+			if (line.op == TACLine::Op::ElemBofA and line.rhsB.type == ValueType::String) {
+				// A member lookup (a.b) whose value is simply assigned: use a dot site
+				// (which, like ElemBofA, gives null rather than an error for a null a).
+				inst.op = TACLine::Op::AssignA;
+				inst.aKind = builder.Encode(Value::SeqElem(line.rhsA, line.rhsB), &inst.a);
+				builder.dotSites[inst.a].fromElemBofA = true;
+				inst.bKind = OperandKind::None;
+				inst.b = 0;
+			} else {
+				inst.aKind = builder.Encode(line.rhsA, &inst.a);
+				inst.bKind = builder.Encode(line.rhsB, &inst.b);
+			}
+
+			// Consecutive lines usually come from the same statement, and
+			// so share a single entry in the location table.
+			long locCount = result->locations.Count();
+			if (locCount == 0 or result->locations[locCount-1].lineNum != line.location.lineNum
+					or result->locations[locCount-1].context != line.location.context) {
+				result->locations.Add(line.location);
+				locCount++;
+			}
+			result->locIndex[i] = (int)(locCount - 1);
+		}
+
+		long constCount = builder.constants.Count();
+		if (constCount > 0) {
+			result->constants = new Value[constCount];
+			for (long i=0; i<constCount; i++) result->constants[i] = builder.constants[i];
+		}
+		long dotSiteCount = builder.dotSites.Count();
+		if (dotSiteCount > 0) {
+			result->dotSites = new DotSite[dotSiteCount];
+			for (long i=0; i<dotSiteCount; i++) result->dotSites[i] = builder.dotSites[i];
+		}
+		long nameCount = builder.names.Count();
+		if (nameCount > 0) {
+			result->names = new NameRef[nameCount];
+			for (long i=0; i<nameCount; i++) result->names[i] = builder.names[i];
+		}
+		result->slotCount = builder.slotNames.Count();
+		if (result->slotCount > 0) {
+			result->slotNames = new String[result->slotCount];
+			for (long i=0; i<result->slotCount; i++) result->slotNames[i] = builder.slotNames[i];
+		}
+		result->tempCount = builder.tempCount;
+		
+		// Note which temps hold the sequence of a 'for' loop.  These are the only
+		// temps that stay in use from one statement to the next.
+		result->sequenceTemps = new bool[result->tempCount];
+		for (long i=0; i<result->tempCount; i++) result->sequenceTemps[i] = false;
+		for (long i=0; i<count; i++) {
+			const TACLine& line = tac[i];
+			if (line.op == TACLine::Op::LengthOfA and line.rhsA.type == ValueType::Temp) {
+				result->sequenceTemps[line.rhsA.data.tempNum] = true;
+			}
+		}
+		
+		FuseSuperinstructions(tac, result);
+		return result;
+	}
+
+	Value Bytecode::OperandValue(OperandKind kind, int index) const {
+		switch (kind) {
+			case OperandKind::Temp:
+				return Value::Temp(index);
+			case OperandKind::Var:
+			case OperandKind::Local:
+			{
+				Value result = Value::Var(names[index].name);
+				result.localOnly = names[index].localOnly;
+				return result;
+			}
+			case OperandKind::Dot:
+				return dotSites[index].seqElem;
+			case OperandKind::Const:
+			case OperandKind::Complex:
+				return constants[index];
+			default:
+				return Value::null;
+		}
+	}
+	
+	TACLine::Op GenericOp(TACLine::Op op) {
+		switch (op) {
+			case TACLine::Op::CallFunctionA_Value:	return TACLine::Op::CallFunctionA;
+			case TACLine::Op::GotoAifB_Num:			return TACLine::Op::GotoAifB;
+			case TACLine::Op::GotoAifNotB_Num:		return TACLine::Op::GotoAifNotB;
+			case TACLine::Op::ElemBofA_ListNum:		return TACLine::Op::ElemBofA;
+			case TACLine::Op::ElemBofA_MapStr:		return TACLine::Op::ElemBofA;
+			case TACLine::Op::ElemBofIterA_ListNum:	return TACLine::Op::ElemBofIterA;
+			case TACLine::Op::LengthOfA_List:		return TACLine::Op::LengthOfA;
+			case TACLine::Op::AEqualB_Branch:		return TACLine::Op::AEqualB;
+			case TACLine::Op::ANotEqualB_Branch:	return TACLine::Op::ANotEqualB;
+			case TACLine::Op::AGreaterThanB_Branch:	return TACLine::Op::AGreaterThanB;
+			case TACLine::Op::AGreatOrEqualB_Branch:	return TACLine::Op::AGreatOrEqualB;
+			case TACLine::Op::ALessThanB_Branch:	return TACLine::Op::ALessThanB;
+			case TACLine::Op::ALessOrEqualB_Branch:	return TACLine::Op::ALessOrEqualB;
+			case TACLine::Op::ForNext:				return TACLine::Op::APlusB;
+			default:								return op;
+		}
+	}
+
+	// Get the map in which to continue a member lookup after a map without
+	// an __isa (i.e., the map type).
+	static Value MapTypeFor(Context *context) {
+		Value result = context->vm->mapType;
+		if (result.IsNull()) result = Intrinsics::MapType();
+		return result;
+	}
+	
+	// Get the epoch of the map (or 0 if it's not a map).
+	static unsigned long long MapEpoch(Value& map) {
+		if (map.type != ValueType::Map) return 0;
+		return map.GetDict().Epoch();
+	}
+	
+	Value DotCache::Resolve(Value receiver, const Value& key, Context *context, ValueDict *outFoundIn) {
+		// Find the map to start from (as in Value::Resolve), checking the
+		// receiver itself first if it's a map.
+		Value start;
+		bool includeMapType = true;
+		switch (receiver.type) {
+			case ValueType::Null:
+				TypeException("Type Error (while attempting to look up " + key.GetString() + ")").raise();
+				break;
+			case ValueType::Map:
+			{
+				ValueDict d = receiver.GetDict();
+				unsigned long long shape = d.ShapeId();
+				Value *found, *isa;
+				if (shape != 0 and shape == receiverShape) {
+					found = receiverFound < 0 ? nullptr : d.ValuePointerAt(receiverFound);
+					isa = receiverIsa < 0 ? nullptr : d.ValuePointerAt(receiverIsa);
+				} else {
+					found = d.GetValuePointer(key);
+					isa = d.GetValuePointer(Value::magicIsA);
+					if (shape != 0) {
+						receiverShape = shape;
+						receiverFound = d.IndexOf(key);
+						receiverIsa = d.IndexOf(Value::magicIsA);
+					}
+				}
+				if (found) {
+					if (outFoundIn) *outFoundIn = d;
+					return *found;
+				}
+				if (isa) {
+					start = *isa;
+				} else {
+					start = MapTypeFor(context);
+					includeMapType = false;
+				}
+			} break;
+			case ValueType::List:
+				start = context->vm->listType;
+				if (start.IsNull()) start = Intrinsics::ListType();
+				includeMapType = false;
+				break;
+			case ValueType::String:
+				start = context->vm->stringType;
+				if (start.IsNull()) start = Intrinsics::StringType();
+				includeMapType = false;
+				break;
+			case ValueType::Number:
+				start = context->vm->numberType;
+				if (start.IsNull()) start = Intrinsics::NumberType();
+				includeMapType = false;
+				break;
+			case ValueType::Function:
+				start = Intrinsics::FunctionType();
+				includeMapType = false;
+				break;
+			default:
+				break;
+		}
+		
+		// Check for a cached chain from there.
+		if (start.type == ValueType::Map) {
+			unsigned long long startEpoch = MapEpoch(start);
+			for (int way=0; way<ways; way++) {
+				Entry& e = entries[way];
+				if (e.depth == 0 or e.epochs[0] != startEpoch or e.includeMapType != includeMapType) continue;
+				Value cur = start;
+				for (int i=0; ; i++) {
+					if (i == e.depth - 1) {
+						if (outFoundIn) *outFoundIn = cur.GetDict();
+						return *e.found;
+					}
+					Value next = e.links[i] ? *e.links[i] : MapTypeFor(context);
+					if (MapEpoch(next) != e.epochs[i+1]) break;
+					cur = next;
+				}
+			}
+		}
+		
+		// Cache miss: walk the chain, recording it as we go.
+		Entry e;
+		e.includeMapType = includeMapType;
+		Value cur = start;
+		for (int i=0; i<maxDepth and cur.type == ValueType::Map; i++) {
+			ValueDict d = cur.GetDict();
+			e.epochs[i] = d.Epoch();
+			Value *found = d.GetValuePointer(key);
+			if (found) {
+				e.depth = i + 1;
+				e.found = found;
+				entries[nextWay] = e;
+				nextWay = (nextWay + 1) % ways;
+				if (outFoundIn) *outFoundIn = d;
+				return *found;
+			}
+			Value *isa = d.GetValuePointer(Value::magicIsA);
+			if (isa) {
+				e.links[i] = isa;
+				cur = *isa;
+			} else {
+				if (not includeMapType) break;
+				e.links[i] = nullptr;
+				cur = MapTypeFor(context);
+				includeMapType = false;
+			}
+		}
+		
+		// Not found, too deep, or something unusual: let Value::Resolve sort it out.
+		return Value::Resolve(receiver, key.GetString(), context, outFoundIn);
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+
+	class TestBytecode : public UnitTest
+	{
+	public:
+		TestBytecode() : UnitTest("Bytecode") {}
+		virtual void Run();
+	};
+
+	void TestBytecode::Run()
+	{
+		Assert(sizeof(Instruction) == 16);
+
+		List<TACLine> tac;
+		tac.Add(TACLine(Value::Var("x"), TACLine::Op::AssignA, Value(42.0)));
+		tac.Add(TACLine(Value::Temp(1), TACLine::Op::APlusB, Value::Var("x"), Value::one));
+		tac.Add(TACLine(Value::Temp(2), TACLine::Op::CallFunctionA, Value::SeqElem(Value::Var("x"), Value("foo")), Value::zero));
+		tac.Add(TACLine(TACLine::Op::GotoA, Value::zero));
+		tac[0].location = SourceLoc("test", 1);
+		tac[1].location = SourceLoc("test", 1);
+		tac[2].location = SourceLoc("test", 2);
+
+		Bytecode *bc = Bytecode::Lower(tac);
+		Assert(bc->count == 4);
+		Assert(bc->code[0].lhsKind == OperandKind::Var and bc->code[0].aKind == OperandKind::Const);
+		Assert(bc->code[1].lhsKind == OperandKind::Temp and bc->code[1].lhs == 1);
+		Assert(bc->code[1].aKind == OperandKind::Var and bc->code[1].a == bc->code[0].lhs);	// (names are shared)
+		Assert(bc->code[1].bKind == OperandKind::Const);
+		Assert(bc->code[2].aKind == OperandKind::Dot);
+		Assert(bc->dotSites[bc->code[2].a].seqKind == OperandKind::Var and bc->dotSites[bc->code[2].a].key == Value("foo"));
+		Assert(bc->code[3].lhsKind == OperandKind::None and bc->code[3].bKind == OperandKind::None);
+		Assert(bc->names[bc->code[0].lhs].name == "x");
+		Assert(bc->GetSourceLoc(1).lineNum == 1);
+		Assert(bc->GetSourceLoc(2).lineNum == 2);
+		Assert(bc->GetSourceLoc(3).IsEmpty());
+		Assert(bc->GetSourceLoc(4).IsEmpty());
+		Assert(bc->OperandValue(bc->code[1].aKind, bc->code[1].a) == Value::Var("x"));
+		Assert(bc->slotCount == 0);
+		bc->release();
+		
+		// In a function, parameters and assigned variables get frame slots.
+		FunctionStorage *func = new FunctionStorage();
+		func->parameters.Add(FuncParam("a", Value::null));
+		bc = Bytecode::Lower(tac, func);
+		Assert(bc->slotCount == 4);
+		Assert(bc->paramSlots[0] == 0 and bc->FindSlot("self") == 1 and bc->FindSlot("x") == 3);
+		Assert(bc->selfSlot == 1 and bc->superSlot == 2);
+		Assert(bc->code[0].lhsKind == OperandKind::Local and bc->code[1].aKind == OperandKind::Local);
+		Assert(bc->names[bc->code[1].a].slot == 3);
+		bc->release();
+		
+		// ...unless the code makes use of 'locals'.
+		tac.Add(TACLine(Value::Temp(0), TACLine::Op::ReturnA, Value::Var("locals")));
+		bc = Bytecode::Lower(tac, func);
+		Assert(bc->slotCount == 0 and bc->code[0].lhsKind == OperandKind::Var);
+		Assert(bc->selfSlot == -1 and bc->superSlot == -1);
+		bc->release();
+		func->release();
+		
+		// Common sequences get superinstructions, unless something jumps into them.
+		tac.Clear();
+		tac.Add(TACLine(Value::Var("i"), TACLine::Op::APlusB, Value::Var("i"), Value::one));	// 0
+		tac.Add(TACLine(Value::Temp(1), TACLine::Op::LengthOfA, Value::Var("seq")));
+		tac.Add(TACLine(Value::Temp(2), TACLine::Op::AGreatOrEqualB, Value::Var("i"), Value::Temp(1)));
+		tac.Add(TACLine(TACLine::Op::GotoAifB, Value(9.0), Value::Temp(2)));
+		tac.Add(TACLine(Value::Var("x"), TACLine::Op::ElemBofIterA, Value::Var("seq"), Value::Var("i")));
+		tac.Add(TACLine(Value::Temp(3), TACLine::Op::ALessThanB, Value::Var("x"), Value(10.0)));	// 5
+		tac.Add(TACLine(TACLine::Op::GotoAifNotB, Value::zero, Value::Temp(3)));
+		tac.Add(TACLine(Value::Temp(4), TACLine::Op::AEqualB, Value::Var("x"), Value(10.0)));	// 7
+		tac.Add(TACLine(TACLine::Op::GotoAifB, Value::zero, Value::Temp(4)));
+		tac.Add(TACLine(Value::Temp(0), TACLine::Op::ReturnA, Value::Temp(4)));	// 9
+		bc = Bytecode::Lower(tac);
+		Assert(bc->code[0].op == TACLine::Op::ForNext);
+		Assert(bc->code[1].op == TACLine::Op::LengthOfA and bc->code[4].op == TACLine::Op::ElemBofIterA);
+		Assert(bc->code[5].op == TACLine::Op::ALessThanB_Branch);
+		Assert(bc->code[7].op == TACLine::Op::AEqualB);	// (_4 is also read on line 9)
+		Assert(GenericOp(bc->code[0].op) == TACLine::Op::APlusB);
+		Assert(GenericOp(bc->code[5].op) == TACLine::Op::ALessThanB);
+		bc->release();
+		
+		tac[8].rhsA = Value(2.0);
+		bc = Bytecode::Lower(tac);
+		Assert(bc->code[0].op == TACLine::Op::APlusB);
+		bc->release();
+	}
+
+	RegisterUnitTest(TestBytecode);
+}
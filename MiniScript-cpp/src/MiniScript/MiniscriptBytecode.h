@@ -0,0 +1,197 @@
+//
+//  MiniscriptBytecode.h
+//  MiniScript
+//
+//	This file defines the compact instruction format that the virtual machine
+//	actually executes.  The parser still produces TAC (see MiniscriptTAC.h), which
+//	is easy to generate, patch, and dump; but just before a block of TAC is first
+//	run, it is lowered into a Bytecode object: a contiguous array of small,
+//	fixed-size Instructions whose operands have been pre-decoded, plus side tables
+//	for constants, identifier names, and source locations.
+//
+//	There is always exactly one Instruction per TACLine, so line numbers (as used
+//	by jumps, Context::lineNum, and partial intrinsic results) mean the same thing
+//	in both forms.  Common sequences of instructions (such as a comparison and
+//	the branch on its result) are sped up by replacing only the first of them with
+//	a superinstruction that does the work of all of them; the rest stay in place.
+//
+//	When lowering a function, identifiers that are local to it (its parameters,
+//	and anything it assigns to) are also resolved to fixed frame slots, so that
+//	they can be accessed by index rather than looked up by name.
+//
+
+#ifndef MINISCRIPTBYTECODE_H
+#define MINISCRIPTBYTECODE_H
+
+#include "MiniscriptTAC.h"
+
+namespace MiniScript {
+
+	// How an Instruction operand should be interpreted.
+	enum class OperandKind : unsigned char {
+		None = 0,		// no operand (evaluates to null)
+		Temp,			// temporary; index is the temp number
+		Const,			// constant pool entry, which evaluates to itself
+		Var,			// identifier; index into the name table
+		Local,			// local variable; index into the name table, whose entry has a slot
+		Dot,			// member lookup like a.b; index into the dot site table
+		Complex			// constant pool entry that must be evaluated (e.g. a SeqElem)
+	};
+
+	/// <summary>
+	/// Get the generic op of which the given op is a quickened form or
+	/// superinstruction (or the op itself, if it is neither).
+	/// </summary>
+	TACLine::Op GenericOp(TACLine::Op op);
+
+	// One executable instruction.  This is deliberately small (16 bytes) and
+	// trivially copyable, so that a whole function's code sits in a few cache lines.
+	// Note that the machine may change op to or from a quickened form as it runs.
+	class Instruction {
+	public:
+		TACLine::Op op;
+		OperandKind lhsKind;
+		OperandKind aKind;
+		OperandKind bKind;
+		int lhs;
+		int a;
+		int b;
+	};
+
+	// Inline cache for a nonlocal identifier, remembering where it was last found:
+	// in the outer or global variables, or among the intrinsics.  It remains valid
+	// as long as no keys are added to or removed from the outer and global maps
+	// (as tracked by their epochs), and the looking-up context has no variables
+	// map of its own that could shadow them.
+	class LookupCache {
+	public:
+		unsigned long long outerEpoch;	// Epoch() of outerVars when cached
+		unsigned long long globalsEpoch;	// Epoch() of the global variables when cached (0 = not valid)
+		Value *found;					// the found value, within one of those maps...
+		Value intrinsic;				// ...or if found is null, the intrinsic function
+		
+		LookupCache() : outerEpoch(0), globalsEpoch(0), found(nullptr) {}
+	};
+
+	// Polymorphic inline cache for a member lookup like a.b, where the member
+	// was not found in a itself.  Each entry remembers the chain of maps that
+	// was searched, starting with a's __isa (or the type map for a's type), by
+	// their epochs and pointers to their __isa values, so that a hit requires
+	// no hashing at all.  As long as each map in the chain still has the same
+	// epoch (i.e. the same keys), the lookup must end up in the same place.
+	// When a is itself a map with a shape (e.g. made with 'new'), we also
+	// remember where in that shape b (or failing that, __isa) was found.
+	class DotCache {
+	public:
+		static const int ways = 4;		// how many different chains we remember
+		static const int maxDepth = 4;	// how many maps deep a cached chain can be
+		
+		DotCache() : nextWay(0), receiverShape(0) {}
+		
+		/// <summary>
+		/// Look up the given key (a string) in the given receiver, exactly like
+		/// Value::Resolve, but using and updating this cache.
+		/// </summary>
+		Value Resolve(Value receiver, const Value& key, Context *context, ValueDict *outFoundIn=nullptr);
+		
+	private:
+		class Entry {
+		public:
+			int depth;								// maps in the chain (0 = unused entry)
+			unsigned long long epochs[maxDepth];	// epoch of each map
+			Value *links[maxDepth];					// its __isa value, or nullptr to go to the map type
+			Value *found;							// the found value, in the last map of the chain
+			bool includeMapType;					// whether the chain may fall back to the map type
+			Entry() : depth(0) {}
+		};
+		Entry entries[ways];
+		int nextWay;
+		
+		unsigned long long receiverShape;	// ShapeId of the last receiver that had one (0 = none)
+		long receiverFound;					// position of the key in that shape, or -1
+		long receiverIsa;					// position of __isa in that shape, or -1
+	};
+	
+	// A place where the code looks up a member by name (a.b), either as an
+	// operand, or via ElemBofA.
+	class DotSite {
+	public:
+		Value seqElem;			// the original operand (a SeqElem)
+		OperandKind seqKind;	// the sequence (a), as an operand
+		int seq;
+		Value key;				// the member name (b)
+		bool viaSuper;			// true if the sequence is the identifier 'super'
+		bool fromElemBofA;		// true if lowered from ElemBofA (e.g. a["b"]), which gives null when a is null
+		DotCache cache;
+
+		DotSite() : seqKind(OperandKind::None), seq(0), viaSuper(false), fromElemBofA(false) {}
+	};
+
+	// An identifier referenced by the code, along with how it should be looked up.
+	class NameRef {
+	public:
+		String name;
+		LocalOnlyMode localOnly;
+		int slot;				// frame slot of this local variable, or -1 if not local
+		LookupCache cache;		// (used for Var operands only)
+
+		NameRef() : localOnly(LocalOnlyMode::Off), slot(-1) {}
+		NameRef(String name, LocalOnlyMode localOnly, int slot=-1) : name(name), localOnly(localOnly), slot(slot) {}
+	};
+
+	class Bytecode : public RefCountedStorage {
+	public:
+		/// <summary>
+		/// Lower the given TAC into a new Bytecode object (with a refCount of 1).
+		/// If func is given, this is the code of that function, and its local
+		/// variables may be resolved to frame slots.
+		/// </summary>
+		static Bytecode* Lower(List<TACLine> tac, FunctionStorage *func=nullptr);
+
+		long count;					// number of instructions
+		Instruction *code;			// the instructions themselves
+		Value *constants;			// constant pool (literals and Complex operands)
+		NameRef *names;				// identifiers referenced by Var and Local operands
+		DotSite *dotSites;			// member lookups referenced by Dot operands
+		long slotCount;				// number of frame slots needed (0 if not using slots)
+		String *slotNames;			// name of the local variable in each slot
+		int *paramSlots;			// slot for each function parameter (if slotCount > 0)
+		int selfSlot;				// slots the machine stores 'self' and 'super' in on
+		int superSlot;				//	a method call (or -1, if slotCount == 0)
+		long tempCount;				// number of temporaries used (so a call frame can be pre-sized)
+		bool *sequenceTemps;		// for each temp, whether it holds the sequence of a 'for' loop
+		
+		/// <summary>
+		/// Find the slot of the given local variable, or return -1.
+		/// </summary>
+		long FindSlot(const String& name) const {
+			for (long i=0; i<slotCount; i++) if (slotNames[i] == name) return i;
+			return -1;
+		}
+
+		/// <summary>
+		/// Get the source location of the given instruction, or an empty
+		/// SourceLoc if out of range.
+		/// </summary>
+		SourceLoc GetSourceLoc(long lineNum) const {
+			if (lineNum < 0 or lineNum >= count) return SourceLoc();
+			return locations[locIndex[lineNum]];
+		}
+
+		/// <summary>
+		/// Reconstruct the original operand of the given kind and index as a
+		/// Value (e.g. for error messages, or for the rare ops that need it).
+		/// </summary>
+		Value OperandValue(OperandKind kind, int index) const;
+
+	private:
+		Bytecode() : count(0), code(nullptr), constants(nullptr), names(nullptr), dotSites(nullptr),
+			slotCount(0), slotNames(nullptr), paramSlots(nullptr), selfSlot(-1), superSlot(-1), tempCount(1), sequenceTemps(nullptr), locIndex(nullptr) {}
+		virtual ~Bytecode();
+
+		List<SourceLoc> locations;	// distinct source locations, in order of appearance
+		int *locIndex;				// index into locations, for each instruction
+	};
+}
+
+#endif /* MINISCRIPTBYTECODE_H */
@@ -13,25 +13,34 @@
 namespace MiniScript {
 	
 	Interpreter::Interpreter() : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-								parser(nullptr), vm(nullptr), hostData(nullptr) {
+								parser(nullptr), vm(nullptr), hostData(nullptr),
+								optimizationLevel(Optimizer::defaultLevel) {
 		
 	}
 
 	Interpreter::Interpreter(String source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr),
+	optimizationLevel(Optimizer::defaultLevel) {
 		Reset(source);
 	}
 	
 	Interpreter::Interpreter(List<String> source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr),
+	optimizationLevel(Optimizer::defaultLevel) {
 		Reset(source);
 	}
 
 	Interpreter::~Interpreter() {
+		MemoryAccount::Scope memoryScope(memory, false);
 		// We own the parser and the VM...
 		delete(parser); parser = nullptr;
 		delete(vm); vm = nullptr;
 		// But we do not own hostData; it's up to the host to deal with that.
+		
+		// Drop the interned names and literals nothing uses any more, and give
+		// back the memory pooled for all we've freed (on this thread).
+		String::PurgeInterned();
+		MemoryPool::Trim();
 	}
 
 	void Interpreter::Reset(List<String> source) {
@@ -40,7 +49,9 @@ namespace MiniScript {
 
 	void Interpreter::Compile() {
 		if (vm) return;		// already compiled
+		MemoryAccount::Scope memoryScope(memory, true);
 		if (not parser) parser = new Parser();
+		parser->optimizationLevel = optimizationLevel;
 		try {
 			parser->Parse(source);
 			vm = parser->CreateVM(standardOutput);
@@ -55,6 +66,7 @@ namespace MiniScript {
 	/// except in special cases; usually you will use RunUntilDone (above) instead.
 	/// </summary>
 	void Interpreter::Step() {
+		MemoryAccount::Scope memoryScope(memory, true);
 		try {
 			Compile();
 			if (vm) vm->Step();
@@ -80,6 +92,7 @@ namespace MiniScript {
 	/// <param name="timeLimit">maximum amout of time to run before returning, in seconds</param>
 	/// <param name="returnEarly">if true, return as soon as we reach an intrinsic that returns a partial result</param>
 	void Interpreter::RunUntilDone(double timeLimit, bool returnEarly) {
+		MemoryAccount::Scope memoryScope(memory, true);
 		long startImpResultCount = 0;
 		try {
 			if (not vm) {
@@ -87,17 +100,9 @@ namespace MiniScript {
 				if (not vm) return;	// (must have been some error)
 			}
 			startImpResultCount = vm->GetGlobalContext()->implicitResultCounter;
-			double startTime = vm->RunTime();
 			vm->yielding = false;
-			int checkRuntimeIn = 15;		// (because vm->RunTime() is expensive on many machines)
-			while (not vm->Done() && !vm->yielding) {
-				if (checkRuntimeIn-- == 0) {
-					if (vm->RunTime() - startTime > timeLimit) return;	// time's up for now!
-					checkRuntimeIn = 15;
-				}
-				vm->Step();		// update the machine
-				if (returnEarly and not vm->GetTopContext()->partialResult.Done()) return;	// waiting for something
-			}
+			vm->Run(timeLimit, returnEarly);
+			if (not vm->Done() and not vm->yielding) return;	// time's up for now, or waiting for something
 		} catch (const MiniscriptException& mse) {
 			ReportError(mse);
 			vm->GetTopContext()->JumpToEnd();
@@ -113,7 +118,9 @@ namespace MiniScript {
 	/// <param name="sourceLine">Source line.</param>
 	/// <param name="timeLimit">Time limit.</param>
 	void Interpreter::REPL(String sourceLine, double timeLimit) {
+		MemoryAccount::Scope memoryScope(memory, true);
 		if (not parser) parser = new Parser();
+		parser->optimizationLevel = optimizationLevel;
 		if (not vm) {
 			vm = parser->CreateVM(standardOutput);
 			vm->interpreter = this;
@@ -137,10 +144,8 @@ namespace MiniScript {
 		try {
 			if (not sourceLine.empty()) parser->Parse(sourceLine, true);
 			if (not parser->NeedMoreInput()) {
-				while (not vm->Done() && !vm->yielding) {
-					if (vm->RunTime() - startTime > timeLimit) return;	// time's up for now!
-					vm->Step();
-				}
+				vm->Run(timeLimit - (vm->RunTime() - startTime), false);
+				if (not vm->Done() and not vm->yielding) return;	// time's up for now!
 				CheckImplicitResult(startImpResultCount);
 			}
 			
@@ -173,6 +178,7 @@ namespace MiniScript {
     /// <returns>Value of the named variable, or null if not found</returns>
     Value Interpreter::GetGlobalValue(String varName) {
         if (not vm) return Value::null;
+		MemoryAccount::Scope memoryScope(memory, false);
 
 		Context* globalContext = vm->GetGlobalContext();
         if (globalContext == nullptr) return Value::null;
@@ -194,6 +200,7 @@ namespace MiniScript {
     /// <param name="value">value to set</param>	
 	void Interpreter::SetGlobalValue(String varName, Value value)
     {
+		MemoryAccount::Scope memoryScope(memory, false);
         if (vm) vm->GetGlobalContext()->SetVar(varName, value);
 	}
 
@@ -44,6 +44,17 @@ namespace MiniScript {
 		/// not need to access this, but it's provided for advanced users.
 		Machine *vm;
 		
+		/// memory: accounts for the memory this interpreter uses (for strings, lists,
+		/// maps, functions, compiled code, etc.).  Check memory.LiveBytes() and
+		/// memory.PeakBytes() to see how much; set memory.limit to cap it, in
+		/// which case a script that tries to go over it gets a LimitExceededException.
+		MemoryAccount memory;
+		
+		/// optimizationLevel: how much the compiler should optimize the code,
+		/// from 0 (not at all) to Optimizer::maxLevel.  See MiniscriptOptimizer.h.
+		/// Changes take effect the next time the source code is compiled.
+		int optimizationLevel;
+		
 		/// Constructors
 		Interpreter();
 		Interpreter(String source);
@@ -51,156 +51,157 @@ namespace MiniScript {
 		randInitialized = true;
 	}
 
-	static IntrinsicResult intrinsic_abs(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(fabs(x.DoubleValue()));
+	static Value intrinsic_abs(Context *context, Value *args) {
+		Value x = args[0];
+		return fabs(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_acos(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(acos(x.DoubleValue()));
+	static Value intrinsic_acos(Context *context, Value *args) {
+		Value x = args[0];
+		return acos(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_asin(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(asin(x.DoubleValue()));
+	static Value intrinsic_asin(Context *context, Value *args) {
+		Value x = args[0];
+		return asin(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_atan(Context *context, IntrinsicResult partialResult) {
-		double y = context->GetVar("y").DoubleValue();
-		double x = context->GetVar("x").DoubleValue();
-		if (x == 1.0) return IntrinsicResult(atan(y));
-		return IntrinsicResult(atan2(y, x));
+	static Value intrinsic_atan(Context *context, Value *args) {
+		double y = args[0].DoubleValue();
+		double x = args[1].DoubleValue();
+		if (x == 1.0) return atan(y);
+		return atan2(y, x);
 	}
 
 	static std::pair<bool, uint64_t> doubleToUnsignedSplit(double val) {
 		return { std::signbit(val), std::abs(val) };
 	}
 	
-	static IntrinsicResult intrinsic_bitAnd(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitAnd(Context *context, Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first & j.first;
 		double val = i.second & j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 	
-	static IntrinsicResult intrinsic_bitOr(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitOr(Context *context, Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first | j.first;
 		double val = i.second | j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 	
-	static IntrinsicResult intrinsic_bitXor(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitXor(Context *context, Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first ^ j.first;
 		double val = i.second ^ j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 
-	static IntrinsicResult intrinsic_char(Context *context, IntrinsicResult partialResult) {
-		long codePoint = context->GetVar("codePoint").IntValue();
+	static Value intrinsic_char(Context *context, Value *args) {
+		long codePoint = args[0].IntValue();
 		char buf[5];
 		long len = UTF8Encode((unsigned long)codePoint, (unsigned char*)buf);
+		if (len == 1 and codePoint > 0) return String::ASCIIChar(buf[0]);
 		String s(buf, (size_t)len);
-		return IntrinsicResult(s);
+		return s;
 	}
 
-	static IntrinsicResult intrinsic_ceil(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(ceil(x.DoubleValue()));
+	static Value intrinsic_ceil(Context *context, Value *args) {
+		Value x = args[0];
+		return ceil(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_code(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_code(Context *context, Value *args) {
+		Value self = args[0];
 		long codepoint = 0;
 		if (not self.IsNull()) codepoint = UTF8Decode((unsigned char*)(self.ToString().c_str()));
-		return IntrinsicResult(codepoint);
+		return codepoint;
 	}
 	
-	static IntrinsicResult intrinsic_cos(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(cos(radians.DoubleValue()));
+	static Value intrinsic_cos(Context *context, Value *args) {
+		Value radians = args[0];
+		return cos(radians.DoubleValue());
 	}
 
-	static IntrinsicResult intrinsic_floor(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(floor(x.DoubleValue()));
+	static Value intrinsic_floor(Context *context, Value *args) {
+		Value x = args[0];
+		return floor(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_function(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_function(Context *context, Value *args) {
 		if (context->vm->functionType.IsNull()) {
 			context->vm->functionType = Intrinsics::FunctionType().EvalCopy(context->vm->GetGlobalContext());
 		}
-		return IntrinsicResult(context->vm->functionType);
+		return context->vm->functionType;
 	};
 
-	static IntrinsicResult intrinsic_hash(Context *context, IntrinsicResult partialResult) {
-		Value obj = context->GetVar("obj");
-		return IntrinsicResult(obj.Hash());
+	static Value intrinsic_hash(Context *context, Value *args) {
+		Value obj = args[0];
+		return obj.Hash();
 	}
 	
-	static IntrinsicResult intrinsic_hasIndex(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value index = context->GetVar("index");
+	static Value intrinsic_hasIndex(Context *context, Value *args) {
+		Value self = args[0];
+		Value index = args[1];
 		if (self.type == ValueType::List) {
 			if (index.type == ValueType::Number) {
 				ValueList list = self.GetList();
 				long i = index.IntValue();
-				return IntrinsicResult(Value::Truth(i >= -list.Count() and i < list.Count()));
+				return Value::Truth(i >= -list.Count() and i < list.Count());
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::String) {
 			if (index.type == ValueType::Number) {
 				String str = self.GetString();
 				long i = index.IntValue();
-				return IntrinsicResult(Value::Truth(i >= -str.Length() and i < str.Length()));
+				return Value::Truth(i >= -str.Length() and i < str.Length());
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			return IntrinsicResult(Value::Truth(map.ContainsKey(index)));
+			return Value::Truth(map.ContainsKey(index));
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 
-	static IntrinsicResult intrinsic_indexes(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_indexes(Context *context, Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			return IntrinsicResult(map.Keys());
+			return map.Keys();
 		} else if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
 			ValueList indexes(count);
 			for (long i=0; i<count; i++) indexes.Add(i);
-			return IntrinsicResult(indexes);
+			return indexes;
 		} else if (self.type == ValueType::String) {
 			String str = self.GetString();
 			long count = str.Length();
 			ValueList indexes(count);
 			for (long i=0; i<count; i++) indexes.Add(i);
-			return IntrinsicResult(indexes);
+			return indexes;
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 
-	static IntrinsicResult intrinsic_indexOf(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value value = context->GetVar("value");
-		Value after = context->GetVar("after");
+	static Value intrinsic_indexOf(Context *context, Value *args) {
+		Value self = args[0];
+		Value value = args[1];
+		Value after = args[2];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
 			long afterIdx = -1;
 			if (!after.IsNull()) afterIdx = after.IntValue();
 			if (afterIdx < -1) afterIdx += count;
-			if (afterIdx < -1 || afterIdx > count-1) return IntrinsicResult::Null;
+			if (afterIdx < -1 || afterIdx > count-1) return Value::null;
 			for (long i=afterIdx+1; i<count; i++) {
-				if (Value::Equality(list[i], value) == 1) return IntrinsicResult(i);
+				if (Value::Equality(list[i], value) == 1) return i;
 			}
 		} else if (self.type == ValueType::String) {
 			String str = self.GetString();
@@ -209,7 +210,7 @@ namespace MiniScript {
 			if (!after.IsNull()) afterIdx = after.IntValue();
 			if (afterIdx < -1) afterIdx += str.Length();
 			long idx = str.IndexOf(s, afterIdx+1);
-			if (idx >= 0) return IntrinsicResult(idx);
+			if (idx >= 0) return idx;
 		} else if (self.type == ValueType::Map) {
 			ValueDict dict = self.GetDict();
 			bool sawAfter = after.IsNull();
@@ -217,17 +218,17 @@ namespace MiniScript {
 				if (!sawAfter) {
 					if (Value::Equality(kv.Key(), after) == 1) sawAfter = true;
 				} else {
-					if (Value::Equality(kv.Value(), value) == 1) return IntrinsicResult(kv.Key());
+					if (Value::Equality(kv.Value(), value) == 1) return kv.Key();
     			}
 			}
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 
-	static IntrinsicResult intrinsic_insert(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value index = context->GetVar("index");
-		Value value = context->GetVar("value");
+	static Value intrinsic_insert(Context *context, Value *args) {
+		Value self = args[0];
+		Value index = args[1];
+		Value value = args[2];
 		if (index.IsNull()) RuntimeException("insert: index argument required").raise();
 		if (index.type != ValueType::Number) RuntimeException("insert: number required for index argument").raise();
 		long idx = index.IntValue();
@@ -237,21 +238,21 @@ namespace MiniScript {
 			if (idx < 0) idx += count + 1;	// +1 because we are inserting AND counting from the end.
 			CheckRange(idx, 0, count);		// and allowing all the way up to .Count here, because insert.
 			list.Insert(value, idx);
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::String) {
 			String s = self.ToString();
 			if (idx < 0) idx += s.Length() + 1;
 			CheckRange(idx, 0, s.Length());
 			s = s.Substring(0, idx) + value.ToString() + s.Substring(idx);
-			return IntrinsicResult(s);
+			return s;
 		} else {
 			RuntimeException("insert called on invalid type").raise();
-			return IntrinsicResult::Null;
+			return Value::null;
 		}
 	}
 
-	static IntrinsicResult intrinsic_intrinsics(Context *context, IntrinsicResult partialResult) {
-		if (_intrinsicsMap.Count() > 0) return IntrinsicResult(_intrinsicsMap);
+	static Value intrinsic_intrinsics(Context *context, Value *args) {
+		if (_intrinsicsMap.Count() > 0) return _intrinsicsMap;
 		
 		for (int i=0; i<Intrinsic::all.Count(); i++) {
 			Intrinsic* intrinsic = Intrinsic::all[i];
@@ -259,86 +260,86 @@ namespace MiniScript {
 			_intrinsicsMap.SetValue(intrinsic->name, intrinsic->GetFunc());
 		}
 		
-		return IntrinsicResult(_intrinsicsMap);
+		return _intrinsicsMap;
 	}
 
-	static IntrinsicResult intrinsic_join(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
-		String delim = context->GetVar("delimiter").ToString();
-		if (val.type != ValueType::List) return IntrinsicResult(val);
+	static Value intrinsic_join(Context *context, Value *args) {
+		Value val = args[0];
+		String delim = args[1].ToString();
+		if (val.type != ValueType::List) return val;
 		ValueList src = val.GetList();
 		StringList list(src.Count());
 		for (int i=0; i<src.Count(); i++) {
 			list.Add(src[i].ToString());
 		}
 		String result = Join(delim, list);
-		return IntrinsicResult(result);
+		return result;
 	}
 	
-	static IntrinsicResult intrinsic_len(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_len(Context *context, Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::List) {
 			ValueList list = val.GetList();
-			return IntrinsicResult(list.Count());
+			return list.Count();
 		} else if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.Length());
+			return str.Length();
 		} else if (val.type == ValueType::Map) {
-			return IntrinsicResult(val.GetDict().Count());
+			return val.GetDict().Count();
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_list(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_list(Context *context, Value *args) {
 		if (context->vm->listType.IsNull()) {
 			context->vm->listType = Intrinsics::ListType().EvalCopy(context->vm->GetGlobalContext());
 		}
-		return IntrinsicResult(context->vm->listType);
+		return context->vm->listType;
 	};
 	
 	
-	static IntrinsicResult intrinsic_log(Context *context, IntrinsicResult partialResult) {
-		double x = context->GetVar("x").DoubleValue();
-		double base = context->GetVar("base").DoubleValue();
+	static Value intrinsic_log(Context *context, Value *args) {
+		double x = args[0].DoubleValue();
+		double base = args[1].DoubleValue();
 		double result;
 		if (fabs(base - 2.718282) < 0.000001) result = log(x);
 		else result = log(x) / log(base);
-		return IntrinsicResult(result);
+		return result;
 	}
 	
-	static IntrinsicResult intrinsic_lower(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_lower(Context *context, Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.ToLower());
+			return str.ToLower();
 		}
-		return IntrinsicResult(val);
+		return val;
 	}
 
-	static IntrinsicResult intrinsic_map(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_map(Context *context, Value *args) {
 		if (context->vm->mapType.IsNull()) {
 			context->vm->mapType = Intrinsics::MapType().EvalCopy(context->vm->GetGlobalContext());
 		}
-		return IntrinsicResult(context->vm->mapType);
+		return context->vm->mapType;
 	};
 	
 	
-	static IntrinsicResult intrinsic_number(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_number(Context *context, Value *args) {
 		if (context->vm->numberType.IsNull()) {
 			context->vm->numberType = Intrinsics::NumberType().EvalCopy(context->vm->GetGlobalContext());
 		}
-		return IntrinsicResult(context->vm->numberType);
+		return context->vm->numberType;
 	};
 	
 	
-	static IntrinsicResult intrinsic_pi(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(M_PI);
+	static Value intrinsic_pi(Context *context, Value *args) {
+		return M_PI;
 	}
 
-	static IntrinsicResult intrinsic_print(Context *context, IntrinsicResult partialResult) {
-		Value s = context->GetVar("s");
+	static Value intrinsic_print(Context *context, Value *args) {
+		Value s = args[0];
 		if (s.IsNull()) s = "null";
-		Value delimiter = context->GetVar("delimiter");
+		Value delimiter = args[1];
 		if (delimiter.IsNull()) {
 			(*context->vm->standardOutput)(s.ToString(), false);
 		} else if (delimiter == _EOL) {
@@ -346,72 +347,66 @@ namespace MiniScript {
 		} else {
 			(*context->vm->standardOutput)(s.ToString() + delimiter.ToString(), false);
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_pop(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_pop(Context *context, Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
-			if (count < 1) return IntrinsicResult::Null;
+			if (count < 1) return Value::null;
 			Value result = list[count-1];
 			list.RemoveAt(count-1);
-			return IntrinsicResult(result);
+			return result;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			if (map.Count() < 1) return IntrinsicResult::Null;
-			ValueDictIterator kv = map.GetIterator();
-			if (!kv.Done()) {
-				Value key = kv.Key();
-				map.Remove(key);
-				return IntrinsicResult(key);
-			}
+			if (map.Count() < 1) return Value::null;
+			Value key = map.KeyAt(0);
+			map.Remove(key);
+			return key;
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_pull(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_pull(Context *context, Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
-			if (count < 1) return IntrinsicResult::Null;
+			if (count < 1) return Value::null;
 			Value result = list[0];
 			list.RemoveAt(0);
-			return IntrinsicResult(result);
+			return result;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			if (map.Count() < 1) return IntrinsicResult::Null;
-			ValueDictIterator kv = map.GetIterator();
-			if (!kv.Done()) {
-				Value key = kv.Key();
-				map.Remove(key);
-				return IntrinsicResult(key);
-			}
+			if (map.Count() < 1) return Value::null;
+			Value key = map.KeyAt(0);
+			map.Remove(key);
+			return key;
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_push(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value value = context->GetVar("value");
+	static Value intrinsic_push(Context *context, Value *args) {
+		Value self = args[0];
+		Value value = args[1];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			list.Add(value);
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
 			map.SetValue(value, Value::one);
-			return IntrinsicResult(self);
+			return self;
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_range(Context *context, IntrinsicResult partialResult) {
-		Value p0 = context->GetVar("from");
-		Value p1 = context->GetVar("to");
-		Value p2 = context->GetVar("step");
+	static Value intrinsic_range(Context *context, Value *args) {
+		Value p0 = args[0];
+		Value p1 = args[1];
+		Value p2 = args[2];
 		double fromVal = p0.DoubleValue();
 		double toVal = p1.DoubleValue();
 		double step = (toVal >= fromVal ? 1 : -1);
@@ -424,16 +419,16 @@ namespace MiniScript {
 			for (double v = fromVal; step > 0 ? (v <= toVal) : (v >= toVal); v += step) {
 				values.Add(v);
 			}
-			return IntrinsicResult(values);
+			return values;
 		} catch (std::bad_alloc e) {
 			LimitExceededException("range() error").raise();
-			return IntrinsicResult::Null;
+			return Value::null;
 		}
 	}
 
-	static IntrinsicResult intrinsic_refEquals(Context *context, IntrinsicResult partialResult) {
-		Value a = context->GetVar("a");
-		Value b = context->GetVar("b");
+	static Value intrinsic_refEquals(Context *context, Value *args) {
+		Value a = args[0];
+		Value b = args[1];
 		bool result;
 		if (a.IsNull()) {
 			result = (b.IsNull());
@@ -450,20 +445,20 @@ namespace MiniScript {
 		} else {
 			result = a.RefEquals(b);
 		}
-		return IntrinsicResult(Value::Truth(result));
+		return Value::Truth(result);
 	}
 	
-	static IntrinsicResult intrinsic_remove(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value k = context->GetVar("k");
+	static Value intrinsic_remove(Context *context, Value *args) {
+		Value self = args[0];
+		Value k = args[1];
 		if (self.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 		if (self.type == ValueType::Map) {
 			ValueDict selfMap = self.GetDict();
 			if (selfMap.ContainsKey(k)) {
 				selfMap.Remove(k);
-				return IntrinsicResult(Value::one);
+				return Value::one;
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::List) {
 			if (k.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 			ValueList selfList = self.GetList();
@@ -471,29 +466,29 @@ namespace MiniScript {
 			if (idx < 0) idx += selfList.Count();
 			CheckRange(idx, 0, selfList.Count()-1);
 			selfList.RemoveAt(idx);
-			return IntrinsicResult::Null;
+			return Value::null;
 		} else if (self.type == ValueType::String) {
 			if (k.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 			String selfStr = self.GetString();
 			String substr = k.ToString();
 			long foundPosB = selfStr.IndexOfB(substr);
-			if (foundPosB < 0) return IntrinsicResult(self);
-			return IntrinsicResult(selfStr.ReplaceB(foundPosB, substr.LengthB(), String()));
+			if (foundPosB < 0) return self;
+			return selfStr.ReplaceB(foundPosB, substr.LengthB(), String());
 		}
 		TypeException("Type Error: 'remove' requires map, list, or string").raise();
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_replace(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value oldval = context->GetVar("oldval");
-		Value newval = context->GetVar("newval");
-		Value maxCountVal = context->GetVar("maxCount");
+	static Value intrinsic_replace(Context *context, Value *args) {
+		Value self = args[0];
+		Value oldval = args[1];
+		Value newval = args[2];
+		Value maxCountVal = args[3];
 		if (self.IsNull()) RuntimeException("argument to 'replace' must not be null").raise();
 		long maxCount = -1;
 		if (!maxCountVal.IsNull()) {
 			maxCount = maxCountVal.IntValue();
-			if (maxCount < 1) return IntrinsicResult(self);
+			if (maxCount < 1) return self;
 		}
 		long count = 0;
 		if (self.type == ValueType::Map) {
@@ -505,7 +500,7 @@ namespace MiniScript {
 					if (maxCount > 0 and count == maxCount) break;
 				}
 			}
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::List) {
 			ValueList selfList = self.GetList();
 			long listCount = selfList.Count();
@@ -516,7 +511,7 @@ namespace MiniScript {
 					if (maxCount > 0 and count == maxCount) break;
 				}
 			}
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::String) {
 			String str = self.ToString();
 			String oldstr = oldval.ToString();
@@ -531,44 +526,44 @@ namespace MiniScript {
 				count++;
 				if (maxCount > 0 && count == maxCount) break;
 			}
-			return IntrinsicResult(str);
+			return str;
 		}
 		TypeException("Type Error: 'replace' requires map, list, or string").raise();
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_round(Context *context, IntrinsicResult partialResult) {
-		double num = context->GetVar("x").DoubleValue();
-		long decimalPlaces = context->GetVar("decimalPlaces").IntValue();
-		if (decimalPlaces == 0) return IntrinsicResult(round(num));	// easy case
+	static Value intrinsic_round(Context *context, Value *args) {
+		double num = args[0].DoubleValue();
+		long decimalPlaces = args[1].IntValue();
+		if (decimalPlaces == 0) return round(num);	// easy case
 		double f = pow(10, decimalPlaces);
-		return IntrinsicResult(round(num*f) / f);
+		return round(num*f) / f;
 	};
 	
-	static IntrinsicResult intrinsic_rnd(Context *context, IntrinsicResult partialResult) {
-		Value seed = context->GetVar("seed");
+	static Value intrinsic_rnd(Context *context, Value *args) {
+		Value seed = args[0];
 		if (seed.IsNull()) InitRand();
 		else InitRand((unsigned int)seed.IntValue());
 		double d = (double)rand() / (RAND_MAX + 1.0);
-		return IntrinsicResult(d);
+		return d;
 	};
 
-	static IntrinsicResult intrinsic_sign(Context *context, IntrinsicResult partialResult) {
-		double num = context->GetVar("x").DoubleValue();
-		if (num < 0) return IntrinsicResult(-1);
-		if (num > 0) return IntrinsicResult(Value::one);
-		return IntrinsicResult(Value::zero);
+	static Value intrinsic_sign(Context *context, Value *args) {
+		double num = args[0].DoubleValue();
+		if (num < 0) return -1;
+		if (num > 0) return Value::one;
+		return Value::zero;
 	};
 
-	static IntrinsicResult intrinsic_sin(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(sin(radians.DoubleValue()));
+	static Value intrinsic_sin(Context *context, Value *args) {
+		Value radians = args[0];
+		return sin(radians.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_slice(Context *context, IntrinsicResult partialResult) {
-		Value seq = context->GetVar("seq");
-		long fromIdx = context->GetVar("from").IntValue();
-		Value toVal = context->GetVar("to");
+	static Value intrinsic_slice(Context *context, Value *args) {
+		Value seq = args[0];
+		long fromIdx = args[1].IntValue();
+		Value toVal = args[2];
 		long toIdx = 0;
 		if (not toVal.IsNull()) toIdx = toVal.IntValue();
 		if (seq.type == ValueType::List) {
@@ -585,7 +580,7 @@ namespace MiniScript {
 					slice.Add(list[i]);
 				}
 			}
-			return IntrinsicResult(slice);
+			return slice;
 		} else if (seq.type == ValueType::String) {
 			String str = seq.GetString();
 			long length = str.Length();
@@ -594,10 +589,10 @@ namespace MiniScript {
 			if (toVal.IsNull()) toIdx = length;
 			else if (toIdx < 0) toIdx += length;
 			if (toIdx > length) toIdx = length;
-			if (toIdx - fromIdx <= 0) return IntrinsicResult(Value::emptyString);
-			return IntrinsicResult(str.Substring(fromIdx, toIdx - fromIdx));
+			if (toIdx - fromIdx <= 0) return Value::emptyString;
+			return str.Substring(fromIdx, toIdx - fromIdx);
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
 
@@ -636,19 +631,19 @@ namespace MiniScript {
 		return sort_lesser(b.sortKey, a.sortKey);
 	}
 
-	static IntrinsicResult intrinsic_sort(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		if (self.type != ValueType::List) return IntrinsicResult(self);
+	static Value intrinsic_sort(Context *context, Value *args) {
+		Value self = args[0];
+		if (self.type != ValueType::List) return self;
 		ValueList list = self.GetList();
-		if (list.Count() < 2) return IntrinsicResult(list);
+		if (list.Count() < 2) return list;
 		
-		bool ascending = context->GetVar("ascending").BoolValue();
+		bool ascending = args[2].BoolValue();
 		
-		Value byKey = context->GetVar("byKey");
+		Value byKey = args[1];
 		if (byKey.IsNull()) {
 			// Simple case: sorting values as themselves.
 			std::stable_sort(&list[0], &list[0] + list.Count(), ascending ? &sort_lesser : &sort_greater);
-			return IntrinsicResult(list);
+			return list;
 		}
 		// Harder case: sorting values by a given map key or function.
 		// Construct an array of ValuePair, sort that, and then convert back into a list of values.
@@ -675,11 +670,11 @@ namespace MiniScript {
 		// Build our output (and release the temp array)
 		for (int i=0; i<list.Count(); i++) list[i] = arr[i].value;
 		delete[] arr;
-		return IntrinsicResult(list);
+		return list;
 	}
 	
-	static IntrinsicResult intrinsic_sqrt(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(sqrt(context->GetVar("x").DoubleValue()));
+	static Value intrinsic_sqrt(Context *context, Value *args) {
+		return sqrt(args[0].DoubleValue());
 	}
 	
 	static IntrinsicResult intrinsic_stackTrace(Context *context, IntrinsicResult partialResult) {
@@ -696,19 +691,19 @@ namespace MiniScript {
 		return IntrinsicResult(result);
 	}
 
-	static IntrinsicResult intrinsic_str(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(context->GetVar("x").ToString());
+	static Value intrinsic_str(Context *context, Value *args) {
+		return args[0].ToString();
 	}
 
-	static IntrinsicResult intrinsic_string(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_string(Context *context, Value *args) {
 		if (context->vm->stringType.IsNull()) {
 			context->vm->stringType = Intrinsics::StringType().EvalCopy(context->vm->GetGlobalContext());
 		}
-		return IntrinsicResult(context->vm->stringType);
+		return context->vm->stringType;
 	};
 	
-	static IntrinsicResult intrinsic_shuffle(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_shuffle(Context *context, Value *args) {
+		Value self = args[0];
 		InitRand();
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
@@ -734,13 +729,13 @@ namespace MiniScript {
 				map.SetValue(keyi, temp);
 			}
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_split(Context *context, IntrinsicResult partialResult) {
-		String self = context->GetVar("self").ToString();
-		String delim = context->GetVar("delimiter").ToString();
-		long maxCount = context->GetVar("maxCount").IntValue();
+	static Value intrinsic_split(Context *context, Value *args) {
+		String self = args[0].ToString();
+		String delim = args[1].ToString();
+		long maxCount = args[2].IntValue();
 		ValueList result;
 		long posB = 0;
 		while (posB < self.LengthB()) {
@@ -753,11 +748,11 @@ namespace MiniScript {
 			posB = nextPos + delim.LengthB();
 			if (posB == self.LengthB() && !delim.empty()) result.Add(Value::emptyString);
 		}
-		return IntrinsicResult(result);
+		return result;
 	}
 	
-	static IntrinsicResult intrinsic_sum(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_sum(Context *context, Value *args) {
+		Value val = args[0];
 		double sum = 0;
 		if (val.type == ValueType::List) {
 			ValueList list = val.GetList();
@@ -770,43 +765,43 @@ namespace MiniScript {
 				sum += kv.Value().DoubleValue();
 			}
 		}
-		return IntrinsicResult(sum);
+		return sum;
 	}
 
-	static IntrinsicResult intrinsic_tan(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(tan(radians.DoubleValue()));
+	static Value intrinsic_tan(Context *context, Value *args) {
+		Value radians = args[0];
+		return tan(radians.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_time(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(context->vm->RunTime());
+	static Value intrinsic_time(Context *context, Value *args) {
+		return context->vm->RunTime();
 	}
 
-	static IntrinsicResult intrinsic_upper(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_upper(Context *context, Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.ToUpper());
+			return str.ToUpper();
 		}
-		return IntrinsicResult(val);
+		return val;
 	}
 	
-	static IntrinsicResult intrinsic_val(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
-		if (val.type == ValueType::Number) return IntrinsicResult(val);
-		if (val.type == ValueType::String) return IntrinsicResult(val.GetString().DoubleValue());
-		return IntrinsicResult::Null;
+	static Value intrinsic_val(Context *context, Value *args) {
+		Value val = args[0];
+		if (val.type == ValueType::Number) return val;
+		if (val.type == ValueType::String) return val.GetString().DoubleValue();
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_values(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_values(Context *context, Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			return IntrinsicResult(map.Values());
+			return map.Values();
 		} else if (self.type == ValueType::String) {
 			String str = self.GetString();
 			ValueList values;
-			if (str.empty()) return IntrinsicResult(values);
+			if (str.empty()) return values;
 			const char *c = str.c_str();
 			const char *endc = c + str.LengthB();
 			while (c < endc) {
@@ -815,12 +810,12 @@ namespace MiniScript {
 				values.Add(String(c, nextc - c));
 				c = nextc;
 			}
-			return IntrinsicResult(values);
+			return values;
 		}
-		return IntrinsicResult(self);
+		return self;
 	}
 
-	static IntrinsicResult intrinsic_version(Context *context, IntrinsicResult partialResult) {
+	static Value intrinsic_version(Context *context, Value *args) {
 		if (context->vm->versionMap.IsNull()) {
 			ValueDict d;
 			d.SetValue("miniscript", VERSION);
@@ -851,7 +846,7 @@ namespace MiniScript {
 			d.SetValue("hostInfo", hostInfo);
 			context->vm->versionMap = Value(d);
 		}
-		return IntrinsicResult(context->vm->versionMap);
+		return context->vm->versionMap;
 	}
 	
 	static IntrinsicResult intrinsic_wait(Context *context, IntrinsicResult partialResult) {
@@ -876,6 +871,16 @@ namespace MiniScript {
 	
 	IntrinsicResult Intrinsic::Execute(long id, Context *context, IntrinsicResult partialResult) {
 		Intrinsic* item = GetByID(id);
+		if (item->nativeCode) {
+			// We're running in our wrapper function's call frame (e.g. because we
+			// were invoked with Machine::ManuallyPushCall), so our arguments are in
+			// its local variables.
+			List<FuncParam>& params = item->function->parameters;
+			long paramCount = params.Count();
+			ValueList args(paramCount);
+			for (long i=0; i<paramCount; i++) args.Add(context->GetVar(params[i].name));
+			return IntrinsicResult(item->nativeCode(context, paramCount > 0 ? &args[0] : nullptr));
+		}
 		return item->code(context, partialResult);
 	}
 
@@ -891,6 +896,7 @@ namespace MiniScript {
 		result->name = name;
 		result->numericID = all.Count();
 		result->function = new FunctionStorage();
+		result->function->intrinsic = result;
 		result->valFunction = Value(result->function);
 		all.Add(result);
 		if (!name.empty()) nameMap.SetValue(name, result);
@@ -917,240 +923,241 @@ namespace MiniScript {
 	void Intrinsics::InitIfNeeded() {
 		if (initialized) return;		// our work is already done; bail out
 		initialized = true;
+		MemoryAccount::Unaccounted unaccounted;		// (intrinsics are shared by all interpreters)
 		Intrinsic *f;
 		
 		f = Intrinsic::Create("abs");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_abs;
+		f->nativeCode = &intrinsic_abs;
 		
 		f = Intrinsic::Create("acos");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_acos;
+		f->nativeCode = &intrinsic_acos;
 		
 		f = Intrinsic::Create("asin");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_asin;
+		f->nativeCode = &intrinsic_asin;
 		
 		f = Intrinsic::Create("atan");
 		f->AddParam("y", 0);
 		f->AddParam("x", 1);
-		f->code = &intrinsic_atan;
+		f->nativeCode = &intrinsic_atan;
 		
 		f = Intrinsic::Create("bitAnd");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitAnd;
+		f->nativeCode = &intrinsic_bitAnd;
 		
 		f = Intrinsic::Create("bitOr");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitOr;
+		f->nativeCode = &intrinsic_bitOr;
 		
 		f = Intrinsic::Create("bitXor");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitXor;
+		f->nativeCode = &intrinsic_bitXor;
 		
 		f = Intrinsic::Create("char");
 		f->AddParam("codePoint", 65);
-		f->code = &intrinsic_char;
+		f->nativeCode = &intrinsic_char;
 		
 		f = Intrinsic::Create("ceil");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_ceil;
+		f->nativeCode = &intrinsic_ceil;
 		
 		f = Intrinsic::Create("code");
 		f->AddParam("self");
-		f->code = &intrinsic_code;
+		f->nativeCode = &intrinsic_code;
 		
 		f = Intrinsic::Create("cos");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_cos;
+		f->nativeCode = &intrinsic_cos;
 		
 		f = Intrinsic::Create("floor");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_floor;
+		f->nativeCode = &intrinsic_floor;
 		
 		f = Intrinsic::Create("funcRef");
-		f->code = &intrinsic_function;
+		f->nativeCode = &intrinsic_function;
 		
 		f = Intrinsic::Create("hash");
 		f->AddParam("obj");
-		f->code = &intrinsic_hash;
+		f->nativeCode = &intrinsic_hash;
 		
 		f = Intrinsic::Create("hasIndex");
 		f->AddParam("self");
 		f->AddParam("index");
-		f->code = &intrinsic_hasIndex;
+		f->nativeCode = &intrinsic_hasIndex;
 		
 		f = Intrinsic::Create("indexes");
 		f->AddParam("self");
-		f->code = &intrinsic_indexes;
+		f->nativeCode = &intrinsic_indexes;
 		
 		f = Intrinsic::Create("indexOf");
 		f->AddParam("self");
 		f->AddParam("value");
 		f->AddParam("after", Value::null);
-		f->code = &intrinsic_indexOf;
+		f->nativeCode = &intrinsic_indexOf;
 		
 		f = Intrinsic::Create("insert");
 		f->AddParam("self");
 		f->AddParam("index");
 		f->AddParam("value");
-		f->code = &intrinsic_insert;
+		f->nativeCode = &intrinsic_insert;
 		
 		f = Intrinsic::Create("intrinsics");
-		f->code = &intrinsic_intrinsics;
+		f->nativeCode = &intrinsic_intrinsics;
 		
 		f = Intrinsic::Create("join");
 		f->AddParam("self");
 		f->AddParam("delimiter", " ");
-		f->code = &intrinsic_join;
+		f->nativeCode = &intrinsic_join;
 		
 		f = Intrinsic::Create("len");
 		f->AddParam("self");
-		f->code = &intrinsic_len;
+		f->nativeCode = &intrinsic_len;
 		
 		f = Intrinsic::Create("list");
-		f->code = &intrinsic_list;
+		f->nativeCode = &intrinsic_list;
 
 		f = Intrinsic::Create("log");
 		f->AddParam("x");
 		f->AddParam("base", 10);
-		f->code = &intrinsic_log;
+		f->nativeCode = &intrinsic_log;
 		
 		f = Intrinsic::Create("lower");
 		f->AddParam("self");
-		f->code = &intrinsic_lower;
+		f->nativeCode = &intrinsic_lower;
 		
 		f = Intrinsic::Create("map");
-		f->code = &intrinsic_map;
+		f->nativeCode = &intrinsic_map;
 		
 		f = Intrinsic::Create("number");
-		f->code = &intrinsic_number;
+		f->nativeCode = &intrinsic_number;
 		
 		f = Intrinsic::Create("pi");
-		f->code = &intrinsic_pi;
+		f->nativeCode = &intrinsic_pi;
 		
 		f = Intrinsic::Create("print");
 		f->AddParam("s", Value::emptyString);
 		f->AddParam("delimiter", _EOL);
-		f->code = &intrinsic_print;
+		f->nativeCode = &intrinsic_print;
 		
 		f = Intrinsic::Create("pop");
 		f->AddParam("self");
-		f->code = &intrinsic_pop;
+		f->nativeCode = &intrinsic_pop;
 		
 		f = Intrinsic::Create("pull");
 		f->AddParam("self");
-		f->code = &intrinsic_pull;
+		f->nativeCode = &intrinsic_pull;
 		
 		f = Intrinsic::Create("push");
 		f->AddParam("self");
 		f->AddParam("value");
-		f->code = &intrinsic_push;
+		f->nativeCode = &intrinsic_push;
 		
 		f = Intrinsic::Create("range");
 		f->AddParam("from", 0);
 		f->AddParam("to", 0);
 		f->AddParam("step");
-		f->code = &intrinsic_range;
+		f->nativeCode = &intrinsic_range;
 		
 		f = Intrinsic::Create("refEquals");
 		f->AddParam("a");
 		f->AddParam("b");
-		f->code = &intrinsic_refEquals;
+		f->nativeCode = &intrinsic_refEquals;
 		
 		f = Intrinsic::Create("remove");
 		f->AddParam("self");
 		f->AddParam("k");
-		f->code = &intrinsic_remove;
+		f->nativeCode = &intrinsic_remove;
 		
 		f = Intrinsic::Create("replace");
 		f->AddParam("self");
 		f->AddParam("oldval");
 		f->AddParam("newval");
 		f->AddParam("maxCount");
-		f->code = &intrinsic_replace;
+		f->nativeCode = &intrinsic_replace;
 		
 		f = Intrinsic::Create("round");
 		f->AddParam("x", 0);
 		f->AddParam("decimalPlaces", 0);
-		f->code = &intrinsic_round;
+		f->nativeCode = &intrinsic_round;
 		
 		f = Intrinsic::Create("rnd");
 		f->AddParam("seed");
-		f->code = &intrinsic_rnd;
+		f->nativeCode = &intrinsic_rnd;
 
 		f = Intrinsic::Create("sign");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_sign;
+		f->nativeCode = &intrinsic_sign;
 
 		f = Intrinsic::Create("sin");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_sin;
+		f->nativeCode = &intrinsic_sin;
 
 		f = Intrinsic::Create("slice");
 		f->AddParam("seq");
 		f->AddParam("from", 0);
 		f->AddParam("to");
-		f->code = &intrinsic_slice;
+		f->nativeCode = &intrinsic_slice;
 
 		f = Intrinsic::Create("sort");
 		f->AddParam("self", 0);
 		f->AddParam("byKey");
 		f->AddParam("ascending", 1);
-		f->code = &intrinsic_sort;
+		f->nativeCode = &intrinsic_sort;
 		
 		f = Intrinsic::Create("split");
 		f->AddParam("self");
 		f->AddParam("delimiter", " ");
 		f->AddParam("maxCount", -1);
-		f->code = &intrinsic_split;
+		f->nativeCode = &intrinsic_split;
 
 		f = Intrinsic::Create("sqrt");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_sqrt;
+		f->nativeCode = &intrinsic_sqrt;
 
 		f = Intrinsic::Create("stackTrace");
 		f->code = &intrinsic_stackTrace;
 
 		f = Intrinsic::Create("str");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_str;
+		f->nativeCode = &intrinsic_str;
 
 		f = Intrinsic::Create("string");
-		f->code = &intrinsic_string;
+		f->nativeCode = &intrinsic_string;
 		
 		f = Intrinsic::Create("shuffle");
 		f->AddParam("self");
-		f->code = &intrinsic_shuffle;
+		f->nativeCode = &intrinsic_shuffle;
 
 		f = Intrinsic::Create("sum");
 		f->AddParam("self");
-		f->code = &intrinsic_sum;
+		f->nativeCode = &intrinsic_sum;
 
 		f = Intrinsic::Create("tan");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_tan;
+		f->nativeCode = &intrinsic_tan;
 
 		f = Intrinsic::Create("time");
-		f->code = &intrinsic_time;
+		f->nativeCode = &intrinsic_time;
 
 		f = Intrinsic::Create("upper");
 		f->AddParam("self");
-		f->code = &intrinsic_upper;
+		f->nativeCode = &intrinsic_upper;
 		
 		f = Intrinsic::Create("val");
 		f->AddParam("self", 0);
-		f->code = &intrinsic_val;
+		f->nativeCode = &intrinsic_val;
 
 		f = Intrinsic::Create("values");
 		f->AddParam("self");
-		f->code = &intrinsic_values;
+		f->nativeCode = &intrinsic_values;
 		
 		f = Intrinsic::Create("version");
-		f->code = &intrinsic_version;
+		f->nativeCode = &intrinsic_version;
 		
 		f = Intrinsic::Create("wait");
 		f->AddParam("seconds", 1);
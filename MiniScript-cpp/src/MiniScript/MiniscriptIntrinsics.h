@@ -57,44 +57,20 @@ namespace MiniScript {
 		static bool initialized;
 	};
 	
-	class IntrinsicResultStorage : public RefCountedStorage {
-	public:
-		bool done;			// true if our work is complete; false if we need to Continue
-		Value result;		// final result if done; in-progress data if not done
-		
-	private:
-		IntrinsicResultStorage() : done(true) {}
-		virtual ~IntrinsicResultStorage() {}
-		friend class IntrinsicResult;
-	};
-	
 	class IntrinsicResult {
 	public:
-		IntrinsicResult() : rs(nullptr) {}
-		IntrinsicResult(Value value, bool done=true) : rs(nullptr) {
-			ensureStorage();
-			rs->result = value;
-			rs->done = done;
-		}
-		IntrinsicResult(const IntrinsicResult& other) {	((IntrinsicResult&)other).ensureStorage(); rs = other.rs; retain(); }
-		IntrinsicResult& operator= (const IntrinsicResult& other) {	((IntrinsicResult&)other).ensureStorage(); other.rs->refCount++; release(); rs = other.rs; return *this; }
-
-		~IntrinsicResult() { release(); }
+		IntrinsicResult() : done(true) {}
+		IntrinsicResult(Value value, bool done=true) : result(std::move(value)), done(done) {}
 		
-		bool Done() { return not rs or rs->done; }
-		Value Result() { return rs ? rs->result : Value::null; }
+		bool Done() { return done; }
+		Value Result() { return result; }
 
 		static IntrinsicResult Null;		// represents a completed, null result
 		static IntrinsicResult EmptyString;	// represents "" (empty string) result
 		
 	private:
-		IntrinsicResult(IntrinsicResultStorage* storage) : rs(storage) {}  // (assumes we grab an existing reference)
-		void forget() { rs = nullptr; }
-		
-		void retain() { if (rs) rs->refCount++; }
-		void release() { if (rs and --(rs->refCount) == 0) { delete rs; rs = nullptr; } }
-		void ensureStorage() { if (!rs) rs = new IntrinsicResultStorage(); }
-		IntrinsicResultStorage *rs;
+		Value result;		// final result if done; in-progress data if not done
+		bool done;			// true if our work is complete; false if we need to Continue
 	};
 
 	class Intrinsic {
@@ -105,6 +81,14 @@ namespace MiniScript {
 		// actual C++ code invoked by the intrinsic
 		IntrinsicResult (*code)(Context *context, IntrinsicResult partialResult);
 		
+		// Alternatively, native code that receives its arguments by position (in
+		// parameter order, with defaults already filled in) and returns its result
+		// directly.  This is called without setting up a call frame, so it is much
+		// faster; but context is then the caller's context, and the code must not
+		// need to suspend (i.e. return a partial result) or alter the call stack.
+		Value (*nativeCode)(Context *context, Value *args);
+		static const int maxNativeParams = 8;	// (beyond this, nativeCode is called via a call frame, like code)
+		
 		// a numeric ID (used internally -- don't worry about this)
 		long id() { return numericID; }
 		
@@ -140,7 +124,7 @@ namespace MiniScript {
 		static List<Intrinsic*> all;
 
 	private:
-		Intrinsic() {}		// don't use this; use Create factory method instead.
+		Intrinsic() : code(nullptr), nativeCode(nullptr) {}		// don't use this; use Create factory method instead.
 
 		FunctionStorage* function;
 		Value valFunction;		// (cached wrapper for function)
@@ -15,6 +15,10 @@ namespace MiniScript {
 
 	Token Token::EOL(Token::Type::EOL);
 	
+	// String literals up to this many bytes are interned (longer ones are
+	// unlikely to be used as map keys, and not worth sharing).
+	static const long maxInternedLiteral = 64;
+	
 	String Token::ToString() {
 		String result;
 		switch (type) {
@@ -178,7 +182,7 @@ namespace MiniScript {
 				if (IsIdentifier(ls->input[ls->positionB])) ls->positionB++;
 				else break;
 			}
-			result.text = ls->input.SubstringB(startPosB, ls->positionB - startPosB);
+			result.text = String::Intern(ls->input.SubstringB(startPosB, ls->positionB - startPosB));
 			result.type = (Keywords::IsKeyword(result.text) ? Token::Type::Keyword : Token::Type::Identifier);
 			if (result.text == "end") {
 				// As a special case: when we see "end", grab the next keyword (after whitespace)
@@ -227,6 +231,7 @@ namespace MiniScript {
 			if (!gotEndQuote) LexerException("missing closing quote (\")").raise();
 			result.text = ls->input.SubstringB(startPosB, ls->positionB - startPosB - 1);
 			if (haveDoubledQuotes) result.text = result.text.Replace("\"\"", "\"");
+			if (result.text.LengthB() <= maxInternedLiteral) result.text = String::Intern(result.text);
 			return result;
 			
 		} else {
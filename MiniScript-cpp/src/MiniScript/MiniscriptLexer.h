@@ -55,9 +55,9 @@ namespace MiniScript {
 			EOL
 		};
 		
-		Token() : type(Type::Unknown) {}
-		Token(Type t) : type(t) {}
-		Token(Type t, String s) : type(t), text(s) {}
+		Token() : type(Type::Unknown), afterSpace(false) {}
+		Token(Type t) : type(t), afterSpace(false) {}
+		Token(Type t, String s) : type(t), text(s), afterSpace(false) {}
 
 		String ToString();
 		
@@ -68,15 +68,13 @@ namespace MiniScript {
 		static Token EOL;
 	};
 	
-	class LexerStorage  {
+	class LexerStorage : public RefCountedStorage {
 	private:
-		LexerStorage(String s) : refCount(1), lineNum(1), input(s), positionB(0) {
+		LexerStorage(String s) : lineNum(1), input(s), positionB(0) {
 			inputLengthB = input.LengthB();
 		}
 		~LexerStorage() {}
 		
-		long refCount;
-		
 		int lineNum;
 		String input;
 		long inputLengthB;
@@ -93,7 +91,7 @@ namespace MiniScript {
 		Lexer() { ls = nullptr; }
 		Lexer(String input) { ls = new LexerStorage(input); }
 		Lexer(const Lexer& other) { ls = other.ls; retain(); }
-		Lexer& operator= (const Lexer& other) { if (other.ls) other.ls->refCount++; release(); ls = other.ls; return *this; }
+		Lexer& operator= (const Lexer& other) { if (other.ls) other.ls->retain(); release(); ls = other.ls; return *this; }
 
 		// destructor
 		~Lexer() { release(); }
@@ -126,8 +124,8 @@ namespace MiniScript {
 		
 	private:
 		Lexer(LexerStorage* storage) : ls(storage) {}  // (assumes we grab an existing reference)
-		void retain() { if (ls) ls->refCount++; }
-		void release() { if (ls and --(ls->refCount) == 0) { delete ls; ls = nullptr; } }
+		void retain() { if (ls) ls->retain(); }
+		void release() { if (ls) { ls->release(); ls = nullptr; } }
 		void ensureStorage() { if (!ls) ls = new LexerStorage(""); }
 		LexerStorage *ls;
 
@@ -0,0 +1,393 @@
+//
+//  MiniscriptOptimizer.cpp
+//  MiniScript
+//
+//	Optimization passes over TAC.
+//
+
+#include "MiniscriptOptimizer.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	// Return whether the given op is a jump, whose rhsA is the line to jump to.
+	static bool IsJump(TACLine::Op op) {
+		return op == TACLine::Op::GotoA or op == TACLine::Op::GotoAifB
+			or op == TACLine::Op::GotoAifTrulyB or op == TACLine::Op::GotoAifNotB;
+	}
+
+	// Return whether the given op always gives the same result for the same
+	// (constant) operands, and has no side effects.
+	static bool IsPure(TACLine::Op op) {
+		switch (op) {
+			case TACLine::Op::APlusB:
+			case TACLine::Op::AMinusB:
+			case TACLine::Op::ATimesB:
+			case TACLine::Op::ADividedByB:
+			case TACLine::Op::AModB:
+			case TACLine::Op::APowB:
+			case TACLine::Op::AEqualB:
+			case TACLine::Op::ANotEqualB:
+			case TACLine::Op::AGreaterThanB:
+			case TACLine::Op::AGreatOrEqualB:
+			case TACLine::Op::ALessThanB:
+			case TACLine::Op::ALessOrEqualB:
+			case TACLine::Op::AAndB:
+			case TACLine::Op::AOrB:
+			case TACLine::Op::NotA:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	static inline bool IsConstant(const Value& v) {
+		return v.type == ValueType::Number or v.type == ValueType::String;
+	}
+
+	static inline bool IsTemp(const Value& v, int tempNum) {
+		return v.type == ValueType::Temp and v.data.tempNum == tempNum;
+	}
+
+	static void MakeNoop(TACLine& line) {
+		line.op = TACLine::Op::Noop;
+		line.lhs = Value::null;
+		line.rhsA = Value::null;
+		line.rhsB = Value::null;
+	}
+
+	// Count the reads and writes of each temp in the given code.
+	static void CountTempUses(List<TACLine>& code, List<int>& reads, List<int>& writes) {
+		for (long i=0, count=code.Count(); i<count; i++) {
+			TACLine& line = code[i];
+			if (line.lhs.type == ValueType::Temp) {
+				int tempNum = line.lhs.data.tempNum;
+				while (writes.Count() <= tempNum) writes.Add(0);
+				writes[tempNum]++;
+			} else Optimizer::CountTempReads(line.lhs, reads);
+			Optimizer::CountTempReads(line.rhsA, reads);
+			Optimizer::CountTempReads(line.rhsB, reads);
+		}
+	}
+
+	// Find which lines of the given code are the target of some jump.
+	// The caller is responsible for deleting the result.
+	static bool* FindJumpTargets(List<TACLine>& code) {
+		long count = code.Count();
+		bool *result = new bool[count + 1];
+		for (long i=0; i<=count; i++) result[i] = false;
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			if (not IsJump(line.op) or line.rhsA.type != ValueType::Number) continue;
+			long target = line.rhsA.IntValue();
+			if (target >= 0 and target <= count) result[target] = true;
+		}
+		return result;
+	}
+
+	void Optimizer::CountTempReads(Value v, List<int>& counts) {
+		switch (v.type) {
+			case ValueType::Temp:
+				while (counts.Count() <= v.data.tempNum) counts.Add(0);
+				counts[v.data.tempNum]++;
+				break;
+			case ValueType::SeqElem:
+			{
+				SeqElemStorage *seqElem = (SeqElemStorage*)(v.data.ref);
+				CountTempReads(seqElem->sequence, counts);
+				CountTempReads(seqElem->index, counts);
+				break;
+			}
+			case ValueType::List:
+			{
+				ValueList list = v.GetList();
+				for (long i=0, count=list.Count(); i<count; i++) CountTempReads(list[i], counts);
+				break;
+			}
+			case ValueType::Map:
+			{
+				ValueDict map = v.GetDict();
+				for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+					CountTempReads(kv.Key(), counts);
+					CountTempReads(kv.Value(), counts);
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	void Optimizer::Optimize(List<TACLine>& code, int level, bool isFunction) {
+		if (level <= 0) return;
+		while (FoldConstants(code) + PropagateCopies(code, isFunction) > 0) {}
+		ThreadJumps(code);
+		if (level >= 2) RemoveDeadCode(code, isFunction);
+	}
+
+	long Optimizer::FoldConstants(List<TACLine>& code) {
+		long changed = 0;
+		for (long i=0, count=code.Count(); i<count; i++) {
+			TACLine& line = code[i];
+			if (IsPure(line.op) and IsConstant(line.rhsA)
+					and (line.op == TACLine::Op::NotA or IsConstant(line.rhsB))) {
+				Value result;
+				try {
+					result = TACLine::Evaluate(line.op, line.rhsA, line.rhsB, nullptr);
+				} catch (MiniscriptException&) {
+					continue;	// (leave it to raise the error at runtime, if it's ever reached)
+				}
+				if (result.type == ValueType::String and result.GetString().LengthB() > maxFoldedStringSize) continue;
+				line.op = TACLine::Op::AssignA;
+				line.rhsA = result;
+				line.rhsB = Value::null;
+				changed++;
+			} else if ((line.op == TACLine::Op::GotoAifB or line.op == TACLine::Op::GotoAifTrulyB
+					or line.op == TACLine::Op::GotoAifNotB) and line.rhsA.type == ValueType::Number
+					and (line.rhsB.IsNull() or IsConstant(line.rhsB))) {
+				// (Same tests as in TACLine::Evaluate.)
+				bool jump;
+				if (line.op == TACLine::Op::GotoAifB) jump = (!line.rhsB.IsNull() and line.rhsB.BoolValue());
+				else if (line.op == TACLine::Op::GotoAifNotB) jump = (line.rhsB.IsNull() or !line.rhsB.BoolValue());
+				else jump = (!line.rhsB.IsNull() and line.rhsB.IntValue() != 0);
+				if (jump) {
+					line.op = TACLine::Op::GotoA;
+					line.rhsB = Value::null;
+				} else MakeNoop(line);
+				changed++;
+			}
+		}
+		return changed;
+	}
+
+	long Optimizer::PropagateCopies(List<TACLine>& code, bool isFunction) {
+		long count = code.Count();
+		List<int> reads, writes;
+		CountTempUses(code, reads, writes);
+		bool *isJumpTarget = FindJumpTargets(code);
+		long changed = 0;
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			if (line.op != TACLine::Op::AssignA or line.lhs.type != ValueType::Temp) continue;
+			int tempNum = line.lhs.data.tempNum;
+			if (tempNum == 0 and isFunction) continue;		// (temp 0 is the function's return value)
+			if (writes[tempNum] != 1 or tempNum >= reads.Count() or reads[tempNum] != 1) continue;
+			Value src = line.rhsA;
+			bool srcIsTemp = (src.type == ValueType::Temp);
+			if (srcIsTemp and (src.data.tempNum == tempNum or src.data.tempNum >= writes.Count()
+							   or writes[src.data.tempNum] != 1)) continue;
+			if (not srcIsTemp and not src.IsNull() and not IsConstant(src)) continue;
+
+			// Find the one use, which must follow in the same block of straight-line code.
+			for (long j=i+1; j<count and not isJumpTarget[j]; j++) {
+				TACLine& use = code[j];
+				if (IsTemp(use.rhsA, tempNum)) use.rhsA = src;
+				else if (IsTemp(use.rhsB, tempNum)) use.rhsB = src;
+				else {
+					// Give up if it's used some other way, or we reach the end of the block,
+					// or (when copying a temp) that temp gets reassigned first.
+					List<int> lineReads;
+					if (use.lhs.type != ValueType::Temp) CountTempReads(use.lhs, lineReads);
+					if (tempNum < lineReads.Count() and lineReads[tempNum] > 0) break;
+					if (use.op == TACLine::Op::GotoA or use.op == TACLine::Op::ReturnA) break;
+					if (srcIsTemp and IsTemp(use.lhs, src.data.tempNum)) break;
+					continue;
+				}
+				MakeNoop(line);
+				changed++;
+				break;
+			}
+		}
+		delete[] isJumpTarget;
+		return changed;
+	}
+
+	long Optimizer::ThreadJumps(List<TACLine>& code) {
+		long count = code.Count();
+		long changed = 0;
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			if (not IsJump(line.op) or line.rhsA.type != ValueType::Number) continue;
+			long target = line.rhsA.IntValue();
+			// Follow the chain of unconditional jumps (and Noops), but not forever,
+			// as it may be an infinite loop.
+			for (long hops=0; hops<count; hops++) {
+				if (target < 0 or target >= count) break;
+				TACLine& next = code[target];
+				if (next.op == TACLine::Op::Noop) {
+					target++;
+					continue;
+				}
+				if (next.op != TACLine::Op::GotoA or next.rhsA.type != ValueType::Number) break;
+				long nextTarget = next.rhsA.IntValue();
+				if (nextTarget == target) break;
+				target = nextTarget;
+			}
+			if (target != line.rhsA.IntValue()) {
+				line.rhsA = Value((double)target);
+				changed++;
+			}
+		}
+		return changed;
+	}
+
+	long Optimizer::RemoveDeadCode(List<TACLine>& code, bool isFunction) {
+		long count = code.Count();
+		if (count == 0) return 0;
+		for (long i=0; i<count; i++) {
+			// (We can't renumber jumps that haven't been backpatched yet.)
+			if (IsJump(code[i].op) and code[i].rhsA.type != ValueType::Number) return 0;
+		}
+
+		// Find the reachable lines, by following every path from the first one.
+		bool *keep = new bool[count];
+		for (long i=0; i<count; i++) keep[i] = false;
+		List<long> toVisit;
+		toVisit.Add(0);
+		while (toVisit.Count() > 0) {
+			long i = toVisit.Pop();
+			if (i < 0 or i >= count or keep[i]) continue;
+			keep[i] = true;
+			TACLine& line = code[i];
+			if (IsJump(line.op)) toVisit.Add(line.rhsA.IntValue());
+			if (line.op == TACLine::Op::GotoA) continue;
+			if (line.op == TACLine::Op::ReturnA and isFunction) continue;
+			toVisit.Add(i + 1);
+		}
+		for (long i=0; i<count; i++) {
+			if (code[i].op == TACLine::Op::Noop) keep[i] = false;
+		}
+
+		// Drop jumps that would land on the same line as falling through, which
+		// may in turn make more such jumps (so, repeat until there are no more).
+		// nextKept[i] is the first kept line at or after i (or count, if none).
+		long *nextKept = new long[count + 1];
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			nextKept[count] = count;
+			for (long i=count-1; i>=0; i--) nextKept[i] = keep[i] ? i : nextKept[i+1];
+			for (long i=count-1; i>=0; i--) {
+				if (not keep[i] or not IsJump(code[i].op)) continue;
+				long target = code[i].rhsA.IntValue();
+				if (target < 0 or target > count) continue;
+				if (nextKept[target] == nextKept[i+1]) {
+					keep[i] = false;
+					changed = true;
+					for (long j=i; j>=0 and nextKept[j] == i; j--) nextKept[j] = nextKept[i+1];
+				}
+			}
+		}
+
+		// Compact the kept lines, and renumber the jumps among them.
+		// (Any removed line was equivalent to going on to the next kept one.)
+		long *newIndex = new long[count + 1];
+		long kept = 0;
+		for (long i=0; i<count; i++) {
+			newIndex[i] = kept;
+			if (keep[i]) kept++;
+		}
+		newIndex[count] = kept;
+		long w = 0;
+		for (long i=0; i<count; i++) {
+			if (not keep[i]) continue;
+			if (w != i) code[w] = code[i];
+			TACLine& line = code[w];
+			if (IsJump(line.op)) {
+				long target = line.rhsA.IntValue();
+				if (target > count) target = count;
+				if (target >= 0) line.rhsA = Value((double)newIndex[target]);
+			}
+			w++;
+		}
+		code.Resize(kept);
+
+		delete[] keep;
+		delete[] nextKept;
+		delete[] newIndex;
+		return count - kept;
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+	//--------------------------------------------------------------------------------
+
+	class TestOptimizer : public UnitTest
+	{
+	public:
+		TestOptimizer() : UnitTest("Optimizer") {}
+		virtual void Run();
+	};
+
+	void TestOptimizer::Run()
+	{
+		List<TACLine> code;
+		code.Add(TACLine(Value::Temp(1), TACLine::Op::ALessThanB, Value::Var("x"), Value(10.0)));	// 0
+		code.Add(TACLine(TACLine::Op::GotoAifNotB, Value(3.0), Value::Temp(1)));	// 1
+		code.Add(TACLine(TACLine::Op::GotoA, Value(4.0)));	// 2
+		code.Add(TACLine(TACLine::Op::GotoA, Value(2.0)));	// 3
+		code.Add(TACLine(TACLine::Op::GotoA, Value(0.0)));	// 4
+		code.Add(TACLine(TACLine::Op::GotoA, Value(5.0)));	// 5 (infinite loop)
+		code.Add(TACLine(TACLine::Op::GotoA, Value(5.0)));	// 6
+		code.Add(TACLine(TACLine::Op::GotoA, Value::null));	// 7 (not yet backpatched)
+		code.Add(TACLine(TACLine::Op::GotoAifB, Value(8.0), Value::Temp(1)));	// 8
+
+		Assert(Optimizer::ThreadJumps(code) == 3);
+		Assert(code[1].rhsA == Value(0.0));	// (via 3, 2, and 4)
+		Assert(code[2].rhsA == Value(0.0));
+		Assert(code[3].rhsA == Value(0.0));
+		Assert(code[4].rhsA == Value(0.0));
+		Assert(code[5].rhsA == Value(5.0));
+		Assert(code[6].rhsA == Value(5.0));
+		Assert(code[7].rhsA.IsNull());
+		Assert(code[8].rhsA == Value(8.0));
+		Assert(Optimizer::ThreadJumps(code) == 0);
+		Assert(Optimizer::RemoveDeadCode(code) == 0);	// (because of line 7)
+
+		// x = 2 * 3 + 1; y = "a" + "b"; if 0 then x = 1; return x
+		code.Clear();
+		code.Add(TACLine(Value::Temp(1), TACLine::Op::ATimesB, Value(2.0), Value(3.0)));	// 0
+		code.Add(TACLine(Value::Var("x"), TACLine::Op::APlusB, Value::Temp(1), Value::one));
+		code.Add(TACLine(Value::Var("y"), TACLine::Op::APlusB, Value("a"), Value("b")));	// 2
+		code.Add(TACLine(TACLine::Op::GotoAifNotB, Value(5.0), Value::zero));
+		code.Add(TACLine(Value::Var("x"), TACLine::Op::AssignA, Value::one));	// 4
+		code.Add(TACLine(Value::Temp(0), TACLine::Op::ReturnA, Value::Var("x")));
+		code.Add(TACLine(Value::Var("x"), TACLine::Op::AssignA, Value::zero));	// 6 (dead)
+
+		Optimizer::Optimize(code, 1, true);
+		Assert(code.Count() == 7);
+		Assert(code[0].op == TACLine::Op::Noop);
+		Assert(code[1].op == TACLine::Op::AssignA and code[1].rhsA == Value(7.0));
+		Assert(code[2].op == TACLine::Op::AssignA and code[2].rhsA == Value("ab"));
+		Assert(code[3].op == TACLine::Op::GotoA and code[3].rhsA == Value(5.0));
+
+		Optimizer::Optimize(code, 2, true);
+		Assert(code.Count() == 3);
+		Assert(code[0].lhs == Value::Var("x") and code[0].rhsA == Value(7.0));
+		Assert(code[1].lhs == Value::Var("y"));
+		Assert(code[2].op == TACLine::Op::ReturnA);
+
+		// Errors, and long strings, are left for runtime.
+		code.Clear();
+		code.Add(TACLine(Value::Var("x"), TACLine::Op::ATimesB, Value("a"), Value("b")));
+		code.Add(TACLine(Value::Var("y"), TACLine::Op::ATimesB, Value("a"), Value(2000.0)));
+		Assert(Optimizer::FoldConstants(code) == 0);
+
+		// A loop: jumps are renumbered when lines are removed.
+		code.Clear();
+		code.Add(TACLine(Value::Temp(1), TACLine::Op::ALessThanB, Value::Var("i"), Value(10.0)));	// 0
+		code.Add(TACLine(TACLine::Op::GotoAifNotB, Value(6.0), Value::Temp(1)));
+		code.Add(TACLine(Value::Temp(2), TACLine::Op::AssignA, Value::one));	// 2
+		code.Add(TACLine(Value::Var("i"), TACLine::Op::APlusB, Value::Var("i"), Value::Temp(2)));
+		code.Add(TACLine(TACLine::Op::GotoA, Value::zero));	// 4
+		code.Add(TACLine(TACLine::Op::GotoA, Value(6.0)));	// 5 (dead)
+		code.Add(TACLine(Value::Temp(0), TACLine::Op::ReturnA, Value::Var("i")));	// 6
+		Optimizer::Optimize(code);
+		Assert(code.Count() == 5);
+		Assert(code[1].op == TACLine::Op::GotoAifNotB and code[1].rhsA == Value(4.0));
+		Assert(code[2].rhsB == Value::one);
+		Assert(code[3].op == TACLine::Op::GotoA and code[3].rhsA == Value::zero);
+	}
+
+	RegisterUnitTest(TestOptimizer);
+}
@@ -0,0 +1,87 @@
+//
+//  MiniscriptOptimizer.h
+//  MiniScript
+//
+//	This file defines the optimizer: passes that rewrite the TAC produced by
+//	the parser into equivalent TAC that runs faster.  These work on TAC (rather
+//	than Bytecode) so that their results can still be inspected by dumping it.
+//	Further improvements that can't be expressed in TAC, such as fusing common
+//	sequences into superinstructions, happen later, in Bytecode::Lower.
+//
+//	Optimization levels are:
+//		0: none; the TAC is exactly as the parser emitted it.
+//		1: constant folding, copy propagation of temps, and jump threading.
+//		   Lines made unnecessary by these become Noops, so no line moves.
+//		2: all of the above, plus removal of dead code (including those Noops),
+//		   which renumbers the lines that remain.
+//
+
+#ifndef MINISCRIPTOPTIMIZER_H
+#define MINISCRIPTOPTIMIZER_H
+
+#include "MiniscriptTAC.h"
+
+namespace MiniScript {
+
+	class Optimizer {
+	public:
+		static const int defaultLevel = 2;
+		static const int maxLevel = 2;
+
+		// String results longer than this (in bytes) are not folded into
+		// constants, but left to be computed at runtime, to keep the code compact.
+		static const long maxFoldedStringSize = 1024;
+
+		/// <summary>
+		/// Optimize the given block of TAC in place, at the given level (see above).
+		/// The code must be complete (a whole function body or program, with all
+		/// jumps backpatched), since we need to see every use of every temp.
+		/// </summary>
+		/// <param name="code">code to optimize</param>
+		/// <param name="level">optimization level, 0 to maxLevel</param>
+		/// <param name="isFunction">true for a function body (where 'return' ends the code)</param>
+		static void Optimize(List<TACLine>& code, int level=defaultLevel, bool isFunction=false);
+
+		/// <summary>
+		/// Evaluate operators whose operands are all constant numbers or strings,
+		/// replacing each with an assignment of the result; and replace conditional
+		/// jumps on a constant with either an unconditional jump or a Noop.
+		/// </summary>
+		/// <returns>the number of lines changed</returns>
+		static long FoldConstants(List<TACLine>& code);
+
+		/// <summary>
+		/// Where a temp is assigned a constant or another temp, and used only once,
+		/// right after that in the same block, use the assigned value directly
+		/// instead (and make the assignment a Noop).
+		/// </summary>
+		/// <returns>the number of temps eliminated</returns>
+		static long PropagateCopies(List<TACLine>& code, bool isFunction=false);
+
+		/// <summary>
+		/// Retarget any jump that leads to an unconditional jump, so that it goes
+		/// straight to the final destination instead.  This comes up at the end of
+		/// nested loops and if blocks, and with 'break' and 'continue'.
+		/// </summary>
+		/// <returns>the number of jumps retargeted</returns>
+		static long ThreadJumps(List<TACLine>& code);
+
+		/// <summary>
+		/// Remove lines that can never be executed (such as those after a 'return'
+		/// or 'break'), Noops, and jumps to the very next line; and renumber the
+		/// jumps in the lines that are left.
+		/// </summary>
+		/// <returns>the number of lines removed</returns>
+		static long RemoveDeadCode(List<TACLine>& code, bool isFunction=false);
+
+		/// <summary>
+		/// Add one to counts[n] for each time the given operand reads temp n,
+		/// anywhere within it (e.g. as part of a dot chain or list literal),
+		/// growing counts as needed.
+		/// </summary>
+		static void CountTempReads(Value v, List<int>& counts);
+	};
+
+}
+
+#endif /* MINISCRIPTOPTIMIZER_H */
@@ -186,6 +186,10 @@ namespace MiniScript {
 			}
 			CheckForOpenBackpatches(tokens.lineNum() + 1);
 		}
+		
+		// Outside the REPL, the main program is now complete, so optimize it.
+		// (Functions are optimized as each one is completed; see ParseMultipleLines.)
+		if (not replMode) Optimizer::Optimize(output->code, optimizationLevel);
 	}
 	
 	/// <summary>
@@ -208,6 +212,7 @@ namespace MiniScript {
 				tokens.Dequeue();
 				if (outputStack.Count() > 1) {
 					CheckForOpenBackpatches(tokens.lineNum() + 1);
+					Optimizer::Optimize(output->code, optimizationLevel, true);
 					outputStack.Pop();
 					output = &outputStack.Last();
 				} else {
@@ -329,7 +334,7 @@ namespace MiniScript {
 				}
 
 				// Create an index variable to iterate over the sequence, initialized to -1.
-				Value idxVar = Value::Var("__" + loopVarTok.text + "_idx");
+				Value idxVar = Value::Var(String::Intern("__" + loopVarTok.text + "_idx"));
 				output->Add(TACLine(idxVar, TACLine::Op::AssignA, -1));
 
 				// We need to note the current line, so we can jump back up to it at the end.
@@ -14,6 +14,7 @@
 #include "Dictionary.h"
 #include "MiniscriptTAC.h"
 #include "MiniscriptLexer.h"
+#include "MiniscriptOptimizer.h"
 
 namespace MiniScript {
 	
@@ -128,7 +129,11 @@ namespace MiniScript {
 		ParseState pendingState;
 		bool pending;
 		
-		Parser() { Reset(); }
+		// How much to optimize the code of each function, and of the main program
+		// (outside the REPL), as soon as it is complete (see MiniscriptOptimizer.h).
+		int optimizationLevel;
+		
+		Parser() : optimizationLevel(Optimizer::defaultLevel) { Reset(); }
 		
 		/// <summary>
 		/// Completely clear out and reset our parse state, throwing out
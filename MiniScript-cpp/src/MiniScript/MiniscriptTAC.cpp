@@ -7,6 +7,8 @@
 //
 
 #include "MiniscriptTAC.h"
+#include "MiniscriptBytecode.h"
+#include "CycleCollector.h"
 #include <math.h>		// for pow() and fmod()
 #include <cmath>		// for std::signbit()
 #if _WIN32 || _WIN64
@@ -27,6 +29,9 @@ namespace MiniScript {
 	String TACLine::ToString() {
 		String text;
 		switch (op) {
+			case Op::Noop:
+				text = "noop";
+				break;
 			case Op::AssignA:
 				text = lhs.ToString() + " := " + rhsA.ToString();
 				break;
@@ -161,7 +166,10 @@ namespace MiniScript {
 		
 		Value opA = rhsA.type == ValueType::Null ? rhsA : rhsA.Val(context);
 		Value opB = rhsB.type == ValueType::Null ? rhsB : rhsB.Val(context);
-		
+		return Evaluate(op, opA, opB, context);
+	}
+	
+	Value TACLine::Evaluate(Op op, Value opA, Value opB, Context *context) {
 		if (op == Op::AisaB) {
 			if (opA.IsNull()) return Value::Truth(opB.IsNull());
 			return Value::Truth(opA.IsA(opB, context->vm));
@@ -181,7 +189,10 @@ namespace MiniScript {
 			} else if (opA.RefEquals(context->vm->functionType)) {
 				RuntimeException("invalid use of 'new'; to create a function, use the 'function' keyword").raise();
 			}
+			// (Instances of the same class share their keys, as long as they
+			// are assigned in the same order; see Dictionary::StartShape.)
 			ValueDict newMap;
+			newMap.StartShape(opA.GetDict());
 			newMap.SetValue(Value::magicIsA, opA);
 			return newMap;
 		}
@@ -515,9 +526,9 @@ namespace MiniScript {
 	void Context::StoreValue(Value lhs, Value value) {
 //		std::cout << "Storing into " << lhs.ToString().c_str() << ": " << value.ToString().c_str() << std::endl;
 		if (lhs.type == ValueType::Temp) {
-			SetTemp(lhs.data.tempNum, value);
+			SetTemp(lhs.data.tempNum, std::move(value));
 		} else if (lhs.type == ValueType::Var) {
-			SetVar(lhs.GetString(), value);
+			SetVar(lhs.GetString(), std::move(value));
 		} else if (lhs.type == ValueType::SeqElem) {
 			SeqElemStorage *seqElem = (SeqElemStorage*)(lhs.data.ref);
 			Value seq = seqElem->sequence.Val(this);
@@ -526,18 +537,25 @@ namespace MiniScript {
 			Value index = seqElem->index;
 			if (index.type == ValueType::Var or index.type == ValueType::SeqElem or
 				index.type == ValueType::Temp) index = index.Val(this);
-			seq.SetElem(index, value);
+			seq.SetElem(index, std::move(value));
 		} else {
 			if (!lhs.IsNull()) RuntimeException("not an lvalue").raise();
 		}
 	}
 
-	void Context::SetVar(String identifier, Value value) {
+	void Context::SetVar(const String& identifier, Value value) {
 		if (identifier == "globals" or identifier == "locals" or identifier == "outer") {
 			RuntimeException("can't assign to " + identifier).raise();
 		}
+		if (slots != nullptr) {
+			long slot = bytecode->FindSlot(identifier);
+			if (slot >= 0) {
+				slots[slot] = std::move(value);
+				return;
+			}
+		}
 		if (!variables.ApplyAssignOverride(identifier, value)) {
-			variables.SetValue(identifier, value);
+			variables.SetValue(identifier, std::move(value));
 		}
 	}
 	
@@ -549,18 +567,31 @@ namespace MiniScript {
 	/// <param name="identifier">name of identifier to look up</param>
 	/// <param name="localOnly">if true, look in local scope only</param>
 	/// <returns>value of that identifier</returns>
-	Value Context::GetVar(String identifier, LocalOnlyMode localOnly) {
+	Value Context::GetVar(const String& identifier, LocalOnlyMode localOnly) {
 		// check for special built-in identifiers 'locals', 'globals', and 'outer'
-		if (identifier == "locals") return variables;
-		if (identifier == "globals") return Root()->variables;
-		if (identifier == "outer") {
+		// (interned, so that comparing with an identifier from the lexer is quick)
+		static const String localsName = String::Intern("locals");
+		static const String globalsName = String::Intern("globals");
+		static const String outerName = String::Intern("outer");
+		if (identifier == localsName) return variables;
+		if (identifier == globalsName) return Root()->variables;
+		if (identifier == outerName) {
 			if (!outerVars.empty()) return outerVars;
 			return Root()->variables;
 		}
 
 		// check for a local variable
 		Value result;
+		if (slots != nullptr) {
+			long slot = bytecode->FindSlot(identifier);
+			if (slot >= 0 and not IsUnassigned(slots[slot])) return slots[slot];
+		}
 		if (variables.Get(identifier, &result)) return result;
+		return GetNonlocalVar(identifier, localOnly);
+	}
+	
+	Value Context::GetNonlocalVar(String identifier, LocalOnlyMode localOnly) {
+		Value result;
 		if (localOnly != LocalOnlyMode::Off) {
 			if (localOnly == LocalOnlyMode::Strict) UndefinedLocalException(identifier).raise();
 			else vm->standardOutput("Warning: assignment of unqualified local '" + identifier
@@ -597,11 +628,23 @@ namespace MiniScript {
 	/// <param name="gotSelf">Whether this method was called with dot syntax.</param>
 	/// <param name="resultStorage">Value to stuff the result into when done.</param>
 	Context* Context::NextCallContext(FunctionStorage *func, long argCount, bool gotSelf, Value resultStorage) {
-		Context* result = new Context();
+		Context* result = vm ? vm->AcquireContext() : new Context();
 		
+		Bytecode *bc = func->GetBytecode();
 		result->code = func->code;
+		result->bytecode = bc;
+		bc->retain();
+		if (bc->slotCount > result->slotCapacity) {
+			delete[] result->slotBuffer;
+			result->slotBuffer = new Value[bc->slotCount];
+			result->slotCapacity = bc->slotCount;
+			for (long i=0; i<bc->slotCount; i++) result->slotBuffer[i] = Value::Temp(0);	// (unassigned)
+		}
+		if (bc->slotCount > 0) result->slots = result->slotBuffer;
+		if (result->temps.Count() < bc->tempCount) result->temps.Resize(bc->tempCount);
 		result->resultStorage = resultStorage;
 		result->parent = this;
+		result->root = Root();
 		result->vm = vm;
 		
 		// Stuff arguments, stored in our 'args' stack,
@@ -616,11 +659,13 @@ namespace MiniScript {
 			if (paramNum >= func->parameters.Count()) {
 				TooManyArgumentsException().raise();
 			}
-			result->SetVar(func->parameters[paramNum].name, argument);
+			if (result->slots) result->slots[bc->paramSlots[paramNum]] = argument;
+			else result->SetVar(func->parameters[paramNum].name, argument);
 		}
 		// And fill in the rest with default values
 		for (long paramNum = argCount+selfParam; paramNum < func->parameters.Count(); paramNum++) {
-			result->SetVar(func->parameters[paramNum].name, func->parameters[paramNum].defaultValue);
+			if (result->slots) result->slots[bc->paramSlots[paramNum]] = func->parameters[paramNum].defaultValue;
+			else result->SetVar(func->parameters[paramNum].name, func->parameters[paramNum].defaultValue);
 		}
 		
 		return result;
@@ -630,8 +675,59 @@ namespace MiniScript {
 		if (lineNum < 0 || lineNum >= code.Count()) {
 			return SourceLoc();
 		}
+		if (bytecode != nullptr and bytecode->count == code.Count()) return bytecode->GetSourceLoc(lineNum);
 		return code[lineNum].location;
 	}
+	
+	Context::~Context() {
+		delete[] slotBuffer;
+		if (bytecode) bytecode->release();
+	}
+	
+	void Context::ResetForReuse() {
+		// Mark our slots unassigned again (releasing their values), and likewise
+		// clear the temps and arguments, but without freeing their buffers.
+		if (slots) {
+			for (long i=0; i<bytecode->slotCount; i++) slots[i] = Value::Temp(0);
+			slots = nullptr;
+		}
+		for (long i=0, count=temps.Count(); i<count; i++) temps[i] = Value::null;
+		while (args.Count() > 0) args.Pop();
+		
+		// Drop references to everything else.  Note that the variables map must
+		// not be cleared, only detached from, as closures may still refer to it.
+		code.Detach();
+		DiscardBytecode();
+		variables.Detach();
+		outerVars.Detach();
+		resultStorage = Value::null;
+		partialResult = IntrinsicResult::Null;
+		lineNum = 0;
+		parent = nullptr;
+		root = nullptr;
+		implicitResultCounter = 0;
+	}
+	
+	void Context::ReleaseDeadTemps(const Value& value) {
+		if (bytecode == nullptr) return;
+		long count = temps.Count();
+		if (count > bytecode->tempCount) count = bytecode->tempCount;
+		for (long i=0; i<count; i++) {
+			if (temps[i].type == value.type and temps[i].RefEquals(value) and not bytecode->sequenceTemps[i]) temps[i] = Value::null;
+		}
+	}
+	
+	void Context::CompileIfNeeded() {
+		if (bytecode != nullptr and bytecode->count == code.Count()) return;
+		if (bytecode) bytecode->release();
+		bytecode = Bytecode::Lower(code);
+		if (temps.Count() < bytecode->tempCount) temps.Resize(bytecode->tempCount);
+	}
+	
+	void Context::DiscardBytecode() {
+		if (bytecode) bytecode->release();
+		bytecode = nullptr;
+	}
 
 //	Machine::Machine() : stack(16), storeImplicit(false) {
 //		Context *globalContext = new Context;
@@ -650,6 +746,26 @@ namespace MiniScript {
 			delete stack[i];
 		}
 		stack.Clear();
+		for (long i = freeContexts.Count() - 1; i >= 0; i--) {
+			delete freeContexts[i];
+		}
+		freeContexts.Clear();
+	}
+	
+	Context* Machine::AcquireContext() {
+		if (freeContexts.Count() > 0) return freeContexts.Pop();
+		Context *result = new Context();
+		result->vm = this;
+		return result;
+	}
+	
+	void Machine::RecycleContext(Context *context) {
+		if (freeContexts.Count() >= maxFreeContexts) {
+			delete context;
+			return;
+		}
+		context->ResetForReuse();
+		freeContexts.Add(context);
 	}
 	
 	void Machine::Step() {
@@ -664,17 +780,24 @@ namespace MiniScript {
 			context = stack.Last();
 		}
 		
-		TACLine& line = context->code[context->lineNum++];
+		context->CompileIfNeeded();
+		Bytecode *bc = context->bytecode;
+		long lineNum = context->lineNum++;
+		bc->retain();		// (the instruction may pop this context, and with it our reference)
+		Instruction& inst = bc->code[lineNum];
+		inst.op = GenericOp(inst.op);	// (DoOneInstruction does not handle quickened ops or superinstructions)
 		try {
-			DoOneLine(line, context);
+			DoOneInstruction(inst, bc, context);
 		} catch (MiniscriptException& mse) {
-			mse.location = line.location;
+			mse.location = bc->GetSourceLoc(lineNum);
+			bc->release();
 			throw;
 		}
+		bc->release();
 	}
 	
 	void Machine::Stop() {
-		while (stack.Count() > 1) delete stack.Pop();
+		while (stack.Count() > 1) RecycleContext(stack.Pop());
 		stack[0]->JumpToEnd();
 	}
 	
@@ -692,55 +815,709 @@ namespace MiniScript {
 		stack.Add(nextContext);
 	}
 
-	void Machine::DoOneLine(TACLine& line, Context *context) {
-		if (line.op == TACLine::Op::PushParam) {
-			Value val = line.rhsA.IsNull() ? line.rhsA : line.rhsA.Val(context);
-			context->PushParamArgument(val);
-		} else if (line.op == TACLine::Op::CallFunctionA) {
+	/// <summary>
+	/// Look up a (non-slot) identifier, using and updating its inline cache
+	/// where possible.
+	/// </summary>
+	static inline Value LookupVar(NameRef& ref, Context *context) {
+		Context *root = context->Root();
+		bool cacheable = (ref.localOnly == LocalOnlyMode::Off and (context == root or context->variables.empty()));
+		if (cacheable) {
+			LookupCache& cache = ref.cache;
+			if (cache.globalsEpoch == root->variables.Epoch() and cache.outerEpoch == context->outerVars.Epoch()
+					and cache.globalsEpoch != 0) {
+				return cache.found ? *cache.found : cache.intrinsic;
+			}
+			// Cache miss: search the same scopes as Context::GetVar, noting where we found it.
+			if (ref.name != "locals" and ref.name != "globals" and ref.name != "outer") {
+				Value *found = nullptr;
+				if (context == root) found = root->variables.GetValuePointer(ref.name);
+				if (!found and !context->outerVars.empty()) found = context->outerVars.GetValuePointer(ref.name);
+				if (!found and context != root) found = root->variables.GetValuePointer(ref.name);
+				Intrinsic *intrinsic = nullptr;
+				if (!found) intrinsic = Intrinsic::GetByName(ref.name);
+				if (found or intrinsic) {
+					cache.found = found;
+					cache.intrinsic = intrinsic ? intrinsic->GetFunc() : Value::null;
+					cache.globalsEpoch = root->variables.Epoch();
+					cache.outerEpoch = context->outerVars.Epoch();
+					return found ? *found : cache.intrinsic;
+				}
+			}
+		}
+		return context->GetVar(ref.name, ref.localOnly);
+	}
+	
+	static inline Value FetchOperand(OperandKind kind, int index, Bytecode *bc, Context *context);
+	
+	/// <summary>
+	/// Evaluate a member lookup (a.b) via its dot site, optionally also
+	/// returning the receiver (a) and the map the member was found in.
+	/// </summary>
+	static Value FetchDot(DotSite& site, Bytecode *bc, Context *context,
+						  ValueDict *outFoundIn=nullptr, Value *outReceiver=nullptr) {
+		if (site.seqKind == OperandKind::None) return Value::null;	// (as in Value::Resolve)
+		Value receiver = FetchOperand(site.seqKind, site.seq, bc, context);
+		if (outReceiver) *outReceiver = receiver;
+		if (site.fromElemBofA and receiver.IsNull()) return Value::null;	// (as ElemBofA does)
+		return site.cache.Resolve(receiver, site.key, context, outFoundIn);
+	}
+	
+	/// <summary>
+	/// Get the value of an instruction operand.
+	/// </summary>
+	static inline Value FetchOperand(OperandKind kind, int index, Bytecode *bc, Context *context) {
+		switch (kind) {
+			case OperandKind::Temp:
+				return context->GetTemp(index, Value::null);
+			case OperandKind::Const:
+				return bc->constants[index];
+			case OperandKind::Var:
+				return LookupVar(bc->names[index], context);
+			case OperandKind::Local:
+			{
+				const NameRef& ref = bc->names[index];
+				const Value& val = context->slots[ref.slot];
+				if (not Context::IsUnassigned(val)) return val;
+				return context->GetNonlocalVar(ref.name, ref.localOnly);
+			}
+			case OperandKind::Dot:
+				return FetchDot(bc->dotSites[index], bc, context);
+			case OperandKind::Complex:
+				return bc->constants[index].Val(context);
+			default:
+				return Value::null;
+		}
+	}
+	
+	/// <summary>
+	/// Get a pointer to where the value of a simple variable operand is stored
+	/// (i.e. where StoreOperand would put a new value), or nullptr if it's not
+	/// that sort of operand, or the variable is not yet assigned.
+	/// </summary>
+	static inline Value* OperandPointer(OperandKind kind, int index, Bytecode *bc, Context *context) {
+		switch (kind) {
+			case OperandKind::Var:
+				if (context->slots != nullptr) return nullptr;
+				return context->variables.GetValuePointer(bc->names[index].name);
+			case OperandKind::Local:
+				return &context->slots[bc->names[index].slot];
+			default:
+				return nullptr;
+		}
+	}
+	
+	/// <summary>
+	/// Return whether the given instruction stores into a variable (rather than
+	/// a temp or a map or list element), which makes it the last step of its
+	/// statement; so it may call Context::ReleaseDeadTemps.
+	/// </summary>
+	static inline bool StoresToVariable(OperandKind lhsKind) {
+		return lhsKind == OperandKind::Var or lhsKind == OperandKind::Local;
+	}
+	
+	/// <summary>
+	/// Handle "s = s + x", where s is a string variable, by appending to s in
+	/// place (when nothing else refers to its storage), so that building up a
+	/// string this way takes linear rather than quadratic time.  Returns false,
+	/// having done nothing, if this is not such a case.
+	/// </summary>
+	static bool AppendInPlace(const Instruction& inst, Value& opA, Value& opB, Bytecode *bc, Context *context) {
+		if (opA.type != ValueType::String or opA.data.ref == nullptr or opB.IsNull()) return false;
+		if (not StoresToVariable(inst.lhsKind)) return false;
+		Value *dest = OperandPointer(inst.lhsKind, inst.lhs, bc, context);
+		if (dest == nullptr or dest->type != ValueType::String or dest->data.ref != opA.data.ref) return false;
+		String sB = opB.ToString();
+		if (opA.GetString().LengthB() + sB.LengthB() > Value::maxStringSize) LimitExceededException("string too large").raise();
+		// We read s into a temp (via "call s"), which is not needed anymore; nor
+		// is any other temp, as this is the statement's last step.
+		opA = Value::null;
+		context->ReleaseDeadTemps(*dest);
+		dest->AppendString(sB);
+		return true;
+	}
+	
+	/// <summary>
+	/// Get the key/value pair at the given index of a map, for a "for" loop that
+	/// stores it in the given lhs operand.  The pair from the previous iteration
+	/// is updated and reused, if nothing else has kept a reference to it.
+	/// </summary>
+	static Value NextKeyValuePair(Value map, Value idx, OperandKind lhsKind, int lhs, Bytecode *bc, Context *context) {
+		ValueDict dict = map.GetDict();
+		long i = idx.IntValue();
+		if (idx.type != ValueType::Number or i < 0 or i >= dict.Count()) {
+			return TACLine::Evaluate(TACLine::Op::ElemBofIterA, map, idx, context);
+		}
+		// (Getting these may rearrange the map, which might be the one holding
+		// the loop variable, so we must do it before looking up the latter.)
+		Value key = dict.KeyAt(i);
+		Value value = dict.ValueAt(i);
+		Value *prev = OperandPointer(lhsKind, lhs, bc, context);
+		// Reading the loop variable in the loop body (e.g. kv.value) leaves a copy
+		// of it in some temp, which is no longer needed.
+		if (prev and prev->type == ValueType::Map and StoresToVariable(lhsKind)) context->ReleaseDeadTemps(*prev);
+		return Value::MakeKeyValuePair(key, value, prev);
+	}
+	
+	/// <summary>
+	/// Store a value into the place indicated by an instruction's lhs operand.
+	/// </summary>
+	static inline void StoreOperand(OperandKind kind, int index, Bytecode *bc, Context *context, Value value) {
+		switch (kind) {
+			case OperandKind::Temp:
+				context->SetTemp(index, std::move(value));
+				break;
+			case OperandKind::Var:
+				context->SetVar(bc->names[index].name, std::move(value));
+				break;
+			case OperandKind::Local:
+				context->slots[bc->names[index].slot] = std::move(value);
+				break;
+			case OperandKind::None:
+				break;
+			case OperandKind::Dot:
+				context->StoreValue(bc->dotSites[index].seqElem, std::move(value));
+				break;
+			default:
+				context->StoreValue(bc->constants[index], std::move(value));
+		}
+	}
+	
+	/// <summary>
+	/// Evaluate an instruction and return the value that would be stored
+	/// into its lhs.  This is the Bytecode equivalent of TACLine::Evaluate.
+	/// </summary>
+	static inline Value EvaluateInstruction(const Instruction& inst, Bytecode *bc, Context *context) {
+		switch (inst.op) {
+			case TACLine::Op::AssignA:
+			case TACLine::Op::ReturnA:
+			case TACLine::Op::AssignImplicit:
+				// List and map literals may contain references that must be evaluated now.
+				if (inst.aKind == OperandKind::Const) {
+					Value& val = bc->constants[inst.a];
+					if (val.type == ValueType::List || val.type == ValueType::Map) return val.FullEval(context);
+					return val;
+				}
+				return FetchOperand(inst.aKind, inst.a, bc, context);
+			case TACLine::Op::CopyA:
+				// Literals must be copied, so each execution gets a unique object.
+				if (inst.aKind == OperandKind::Const) return bc->constants[inst.a].EvalCopy(context);
+				return FetchOperand(inst.aKind, inst.a, bc, context);
+			default:
+				return TACLine::Evaluate(inst.op,
+										 FetchOperand(inst.aKind, inst.a, bc, context),
+										 FetchOperand(inst.bKind, inst.b, bc, context),
+										 context);
+		}
+	}
+
+	/// <summary>
+	/// Call the native code of an intrinsic directly, without a call frame,
+	/// binding the arguments pushed by the caller to its parameters just as
+	/// NextCallContext would.
+	/// </summary>
+	static Value CallNativeIntrinsic(FunctionStorage *fs, long argCount, const Value& self, Context *context) {
+		Value args[Intrinsic::maxNativeParams];
+		long paramCount = fs->parameters.Count();
+		long selfParam = (not self.IsNull() and paramCount > 0 and fs->parameters[0].name == "self" ? 1 : 0);
+		if (argCount + selfParam > paramCount) {
+			for (long i = 0; i < argCount; i++) context->args.Pop();
+			TooManyArgumentsException().raise();
+		}
+		// Careful -- when we pop them off, they're in reverse order.
+		for (long i = argCount - 1; i >= 0; i--) args[i + selfParam] = context->args.Pop();
+		if (selfParam) args[0] = self;
+		for (long i = argCount + selfParam; i < paramCount; i++) args[i] = fs->parameters[i].defaultValue;
+		return fs->intrinsic->nativeCode(context, args);
+	}
+
+	void Machine::DoOneInstruction(Instruction& inst, Bytecode *bc, Context *context) {
+		if (inst.op == TACLine::Op::PushParam) {
+			context->PushParamArgument(FetchOperand(inst.aKind, inst.a, bc, context));
+		} else if (inst.op == TACLine::Op::CallFunctionA) {
 			// Resolve rhsA.  If it's a function, invoke it; otherwise,
 			// just store it directly.
 			ValueDict valueFoundIn;
-			Value funcVal = line.rhsA.Val(context, &valueFoundIn);		// resolves the whole dot chain, if any
+			Value funcVal;
+			Value receiver;
+			if (inst.aKind == OperandKind::Dot) {
+				funcVal = FetchDot(bc->dotSites[inst.a], bc, context, &valueFoundIn, &receiver);
+			} else if (inst.aKind == OperandKind::Complex) {
+				funcVal = bc->constants[inst.a].Val(context, &valueFoundIn);	// resolves the whole dot chain, if any
+			} else {
+				funcVal = FetchOperand(inst.aKind, inst.a, bc, context);
+			}
+			long argCount = FetchOperand(inst.bKind, inst.b, bc, context).IntValue();
 			if (funcVal.type == ValueType::Function) {
 				Value self;
 				// bind "super" to the parent of the map the function was found in
 				Value super = valueFoundIn.Lookup(Value::magicIsA, Value::null);
-				if (line.rhsA.type == ValueType::SeqElem) {
+				if (inst.aKind == OperandKind::Dot) {
+					// bind "self" to the object used to invoke the call,
+					// except when invoking via "super"
+					if (bc->dotSites[inst.a].viaSuper) self = context->GetVar("self");
+					else self = receiver;
+				} else if (inst.aKind == OperandKind::Complex and bc->constants[inst.a].type == ValueType::SeqElem) {
 					// bind "self" to the object used to invoke the call,
 					// except when invoking via "super"
-					Value seq = ((SeqElemStorage*)(line.rhsA.data.ref))->sequence;
+					Value seq = ((SeqElemStorage*)(bc->constants[inst.a].data.ref))->sequence;
 					if (seq.type == ValueType::Var && seq.ToString() == "super") self = context->GetVar("self");
 					else self = seq.Val(context);
 				}
-				long argCount = line.rhsB.IntValue();
 				FunctionStorage *fs = (FunctionStorage*)(funcVal.data.ref);
-				Context* nextContext = context->NextCallContext(fs, argCount, not self.IsNull(), line.lhs);
+				if (fs->intrinsic != nullptr and fs->intrinsic->nativeCode != nullptr
+						and fs->parameters.Count() <= Intrinsic::maxNativeParams) {
+					Value result = CallNativeIntrinsic(fs, argCount, self, context);
+					StoreOperand(inst.lhsKind, inst.lhs, bc, context, result);
+					return;
+				}
+				Context* nextContext = context->NextCallContext(fs, argCount, not self.IsNull(),
+																bc->OperandValue(inst.lhsKind, inst.lhs));
 				nextContext->outerVars = fs->outerVars;
-				if (!valueFoundIn.empty()) nextContext->SetVar("super", super);
-				if (not self.IsNull()) nextContext->SetVar("self", self);
+				// (Set these straight into their slots when we can, with no name lookup.)
+				Bytecode *nextBC = nextContext->bytecode;
+				if (!valueFoundIn.empty()) {
+					if (nextContext->slots) nextContext->slots[nextBC->superSlot] = std::move(super);
+					else nextContext->SetVar("super", std::move(super));
+				}
+				if (not self.IsNull()) {
+					if (nextContext->slots) nextContext->slots[nextBC->selfSlot] = std::move(self);
+					else nextContext->SetVar("self", std::move(self));
+				}
 				stack.Add(nextContext);
 			} else {
 				// The user is attempting to call something that's not a function.
 				// We'll allow that, but any number of parameters is too many.  [#35]
 				// (No need to pop them, as the exception will pop the whole call stack anyway.)
-				long argCount = line.rhsB.IntValue();
 				if (argCount > 0) TooManyArgumentsException().raise();
-				context->StoreValue(line.lhs, funcVal);
+				StoreOperand(inst.lhsKind, inst.lhs, bc, context, funcVal);
+				// This is usually just a variable reference; next time, treat it as such.
+				if (inst.bKind == OperandKind::Const or inst.bKind == OperandKind::None) {
+					inst.op = TACLine::Op::CallFunctionA_Value;
+				}
 			}
-		} else if (line.op == TACLine::Op::ReturnA) {
-			Value val = line.Evaluate(context);
-			context->StoreValue(line.lhs, val);
+		} else if (inst.op == TACLine::Op::ReturnA) {
+			Value val = EvaluateInstruction(inst, bc, context);
+			StoreOperand(inst.lhsKind, inst.lhs, bc, context, val);
 			PopContext();
-		} else if (line.op == TACLine::Op::AssignImplicit) {
-			Value val = line.Evaluate(context);
+		} else if (inst.op == TACLine::Op::AssignImplicit) {
+			Value val = EvaluateInstruction(inst, bc, context);
 			if (storeImplicit) {
 				context->StoreValue(Value::implicitResult, val);
 				context->implicitResultCounter++;
 			}
 		} else {
-			Value val = line.Evaluate(context);
-			context->StoreValue(line.lhs, val);
+			Value val = EvaluateInstruction(inst, bc, context);
+			StoreOperand(inst.lhsKind, inst.lhs, bc, context, val);
+		}
+	}
+
+	// Use computed goto ("labels as values") for instruction dispatch where the
+	// compiler supports it; otherwise fall back to an ordinary switch.
+	#ifndef MINISCRIPT_COMPUTED_GOTO
+		#if defined(__GNUC__) || defined(__clang__)
+			#define MINISCRIPT_COMPUTED_GOTO 1
+		#else
+			#define MINISCRIPT_COMPUTED_GOTO 0
+		#endif
+	#endif
+
+	// How many safe points (backward jumps and calls) to pass between checks
+	// of the wall clock, which is relatively expensive on some platforms (and
+	// for a cycle collection, if one is due).
+	static const int safePointsPerTimeCheck = 64;
+
+	void Machine::Run(double timeLimit, bool returnEarly) {
+		if (stack.Count() == 0) return;		// not even a global context
+		if (startTime == 0) startTime = CurrentWallClockTime();
+		double endTime = CurrentWallClockTime() + timeLimit;
+		int safePointCountdown = safePointsPerTimeCheck;
+		
+		Context *context = nullptr;			// context we're currently running
+		Bytecode *bc = nullptr;				// its bytecode (retained while we use it)
+		Instruction *code = nullptr;		// bc->code
+		long count = 0;						// bc->count
+		Instruction *inst = nullptr;		// instruction being executed (which we may quicken)
+		long depth = 0;						// (used by CallIntrinsicA)
+		
+		#define OPERAND_A	FetchOperand(inst->aKind, inst->a, bc, context)
+		#define OPERAND_B	FetchOperand(inst->bKind, inst->b, bc, context)
+		#define STORE_LHS(val)	StoreOperand(inst->lhsKind, inst->lhs, bc, context, val)
+		#define FETCH() \
+			if (context->lineNum >= count) goto frameDone; \
+			inst = &code[context->lineNum++]
+		#define SAFE_POINT() \
+			if (--safePointCountdown <= 0) { \
+				safePointCountdown = safePointsPerTimeCheck; \
+				if (CurrentWallClockTime() > endTime) goto stop; \
+				CycleCollector::CollectIfDue(); \
+			}
+		// Note that NEXT() must never be used inside a block that has live Value
+		// objects, since a computed goto does not run their destructors.
+		#if MINISCRIPT_COMPUTED_GOTO
+			#define HANDLER(name)	case TACLine::Op::name: op_##name:
+			#define NEXT()			{ FETCH(); goto *dispatchTable[(int)inst->op]; }
+			static void* dispatchTable[] = {
+				&&op_Noop, &&op_AssignA, &&op_AssignImplicit, &&op_APlusB, &&op_AMinusB,
+				&&op_ATimesB, &&op_ADividedByB, &&op_AModB, &&op_APowB, &&op_AEqualB,
+				&&op_ANotEqualB, &&op_AGreaterThanB, &&op_AGreatOrEqualB, &&op_ALessThanB,
+				&&op_ALessOrEqualB, &&op_AisaB, &&op_AAndB, &&op_AOrB, &&op_BindAssignA,
+				&&op_CopyA, &&op_NewA, &&op_NotA, &&op_GotoA, &&op_GotoAifB, &&op_GotoAifTrulyB,
+				&&op_GotoAifNotB, &&op_PushParam, &&op_CallFunctionA, &&op_CallIntrinsicA,
+				&&op_ReturnA, &&op_ElemBofA, &&op_ElemBofIterA, &&op_LengthOfA,
+				&&op_CallFunctionA_Value, &&op_GotoAifB_Num, &&op_GotoAifNotB_Num, &&op_ElemBofA_ListNum,
+				&&op_ElemBofA_MapStr, &&op_ElemBofIterA_ListNum, &&op_LengthOfA_List,
+				&&op_AEqualB_Branch, &&op_ANotEqualB_Branch, &&op_AGreaterThanB_Branch,
+				&&op_AGreatOrEqualB_Branch, &&op_ALessThanB_Branch, &&op_ALessOrEqualB_Branch, &&op_ForNext
+			};
+			static_assert(sizeof(dispatchTable)/sizeof(dispatchTable[0]) == (int)TACLine::Op::ForNext + 1,
+						  "dispatchTable must have one entry per TACLine::Op");
+		#else
+			#define HANDLER(name)	case TACLine::Op::name:
+			#define NEXT()			goto dispatch
+		#endif
+		// Numeric fast path for binary operators; anything else goes through TACLine::Evaluate.
+		#define NUMERIC_HANDLER(name, expr) \
+			HANDLER(name) { \
+				Value opA = OPERAND_A; \
+				Value opB = OPERAND_B; \
+				if (opA.type == ValueType::Number and opB.type == ValueType::Number) { \
+					double fA = opA.data.number, fB = opB.data.number; \
+					STORE_LHS(expr); \
+				} else STORE_LHS(TACLine::Evaluate(inst->op, opA, opB, context)); \
+			} \
+			NEXT();
+		#define GENERIC_HANDLER(name) \
+			HANDLER(name) { \
+				STORE_LHS(TACLine::Evaluate(inst->op, OPERAND_A, OPERAND_B, context)); \
+			} \
+			NEXT();
+		// Comparison whose result (a temp nobody else reads) is only used to decide
+		// the conditional jump that follows it.
+		#define COMPARE_BRANCH_HANDLER(name, genericOp, cmp) \
+			HANDLER(name) { \
+				Value opA = OPERAND_A; \
+				Value opB = OPERAND_B; \
+				bool isTrue; \
+				if (opA.type == ValueType::Number and opB.type == ValueType::Number) { \
+					isTrue = (opA.data.number cmp opB.data.number); \
+				} else { \
+					Value result = TACLine::Evaluate(TACLine::Op::genericOp, opA, opB, context); \
+					isTrue = (!result.IsNull() and result.BoolValue()); \
+				} \
+				Instruction *branch = inst + 1; \
+				if (isTrue == (GenericOp(branch->op) == TACLine::Op::GotoAifB)) { \
+					long from = context->lineNum; \
+					context->lineNum = (long)bc->constants[branch->a].data.number; \
+					if (context->lineNum < from) SAFE_POINT(); \
+				} else context->lineNum++; \
+			} \
+			NEXT();
+		
+		try {
+		loadFrame:
+			// (Re)load our state from whatever context is now on top of the stack.
+			context = stack.Last();
+			context->CompileIfNeeded();
+			if (bc != context->bytecode) {
+				if (bc) bc->release();
+				bc = context->bytecode;
+				bc->retain();
+			}
+			code = bc->code;
+			count = bc->count;
+			inst = nullptr;
+			
+		#if !MINISCRIPT_COMPUTED_GOTO
+		dispatch:		// (only the switch needs this; computed gotos go straight to the handler)
+		#endif
+			FETCH();
+		redispatch:
+			switch (inst->op) {
+				HANDLER(Noop) NEXT();
+				
+				HANDLER(AssignA)
+				HANDLER(CopyA) {
+					STORE_LHS(EvaluateInstruction(*inst, bc, context));
+				}
+				NEXT();
+				
+				HANDLER(AssignImplicit) {
+					Value val = EvaluateInstruction(*inst, bc, context);
+					if (storeImplicit) {
+						context->StoreValue(Value::implicitResult, val);
+						context->implicitResultCounter++;
+					}
+				}
+				NEXT();
+				
+				HANDLER(APlusB) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					if (opA.type == ValueType::Number and opB.type == ValueType::Number) {
+						STORE_LHS(Value(opA.data.number + opB.data.number));
+					} else if (not AppendInPlace(*inst, opA, opB, bc, context)) {
+						STORE_LHS(TACLine::Evaluate(inst->op, opA, opB, context));
+					}
+				}
+				NEXT();
+				NUMERIC_HANDLER(AMinusB, Value(fA - fB))
+				NUMERIC_HANDLER(ATimesB, Value(fA * fB))
+				NUMERIC_HANDLER(ADividedByB, Value(fA / fB))
+				NUMERIC_HANDLER(AModB, Value(fmod(fA, fB)))
+				NUMERIC_HANDLER(APowB, Value(pow(fA, fB)))
+				NUMERIC_HANDLER(AEqualB, Value::Truth(fA == fB))
+				NUMERIC_HANDLER(ANotEqualB, Value::Truth(fA != fB))
+				NUMERIC_HANDLER(AGreaterThanB, Value::Truth(fA > fB))
+				NUMERIC_HANDLER(AGreatOrEqualB, Value::Truth(fA >= fB))
+				NUMERIC_HANDLER(ALessThanB, Value::Truth(fA < fB))
+				NUMERIC_HANDLER(ALessOrEqualB, Value::Truth(fA <= fB))
+				
+				GENERIC_HANDLER(AisaB)
+				GENERIC_HANDLER(AAndB)
+				GENERIC_HANDLER(AOrB)
+				GENERIC_HANDLER(BindAssignA)
+				GENERIC_HANDLER(NewA)
+				GENERIC_HANDLER(NotA)
+				
+				HANDLER(ElemBofA) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					STORE_LHS(TACLine::Evaluate(TACLine::Op::ElemBofA, opA, opB, context));
+					if (opA.type == ValueType::List and opB.type == ValueType::Number) inst->op = TACLine::Op::ElemBofA_ListNum;
+					else if (opA.type == ValueType::Map and opB.type == ValueType::String) inst->op = TACLine::Op::ElemBofA_MapStr;
+				}
+				NEXT();
+				
+				HANDLER(ElemBofA_ListNum) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					if (opA.type == ValueType::List and opB.type == ValueType::Number) STORE_LHS(opA.GetElem(opB));
+					else {
+						inst->op = TACLine::Op::ElemBofA;
+						STORE_LHS(TACLine::Evaluate(TACLine::Op::ElemBofA, opA, opB, context));
+					}
+				}
+				NEXT();
+				
+				HANDLER(ElemBofA_MapStr) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					Value *found = nullptr;
+					if (opA.type == ValueType::Map and opB.type == ValueType::String) found = opA.GetDict().GetValuePointer(opB);
+					else inst->op = TACLine::Op::ElemBofA;
+					// (If not found directly in the map, fall back to walking its __isa chain.)
+					Value result = found ? *found : TACLine::Evaluate(TACLine::Op::ElemBofA, opA, opB, context);
+					STORE_LHS(result);
+				}
+				NEXT();
+				
+				HANDLER(ElemBofIterA) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					if (opA.type == ValueType::Map) STORE_LHS(NextKeyValuePair(opA, opB, inst->lhsKind, inst->lhs, bc, context));
+					else STORE_LHS(TACLine::Evaluate(TACLine::Op::ElemBofIterA, opA, opB, context));
+					if (opA.type == ValueType::List and opB.type == ValueType::Number) inst->op = TACLine::Op::ElemBofIterA_ListNum;
+				}
+				NEXT();
+				
+				HANDLER(ElemBofIterA_ListNum) {
+					Value opA = OPERAND_A;
+					Value opB = OPERAND_B;
+					if (opA.type == ValueType::List and opB.type == ValueType::Number) STORE_LHS(opA.GetElem(opB));
+					else {
+						inst->op = TACLine::Op::ElemBofIterA;
+						STORE_LHS(TACLine::Evaluate(TACLine::Op::ElemBofIterA, opA, opB, context));
+					}
+				}
+				NEXT();
+				
+				HANDLER(LengthOfA) {
+					Value opA = OPERAND_A;
+					STORE_LHS(TACLine::Evaluate(TACLine::Op::LengthOfA, opA, OPERAND_B, context));
+					if (opA.type == ValueType::List) inst->op = TACLine::Op::LengthOfA_List;
+				}
+				NEXT();
+				
+				HANDLER(LengthOfA_List) {
+					Value opA = OPERAND_A;
+					if (opA.type == ValueType::List) STORE_LHS(Value(opA.GetList().Count()));
+					else {
+						inst->op = TACLine::Op::LengthOfA;
+						STORE_LHS(TACLine::Evaluate(TACLine::Op::LengthOfA, opA, OPERAND_B, context));
+					}
+				}
+				NEXT();
+				
+				HANDLER(GotoA) {
+					Value target = OPERAND_A;
+					if (target.type == ValueType::Number) {
+						long from = context->lineNum;
+						context->lineNum = (int)target.data.number;
+						if (context->lineNum < from) SAFE_POINT();
+					}
+				}
+				NEXT();
+				
+				HANDLER(GotoAifB)
+				HANDLER(GotoAifTrulyB)
+				HANDLER(GotoAifNotB) {
+					Value target = OPERAND_A;
+					if (target.type == ValueType::Number) {
+						Value opB = OPERAND_B;
+						bool jump;
+						if (inst->op == TACLine::Op::GotoAifB) jump = (!opB.IsNull() and opB.BoolValue());
+						else if (inst->op == TACLine::Op::GotoAifNotB) jump = (opB.IsNull() or !opB.BoolValue());
+						else jump = (!opB.IsNull() and opB.IntValue() != 0);	// (GotoAifTrulyB)
+						if (opB.type == ValueType::Number and inst->aKind == OperandKind::Const) {
+							if (inst->op == TACLine::Op::GotoAifB) inst->op = TACLine::Op::GotoAifB_Num;
+							else if (inst->op == TACLine::Op::GotoAifNotB) inst->op = TACLine::Op::GotoAifNotB_Num;
+						}
+						if (jump) {
+							long from = context->lineNum;
+							context->lineNum = (int)target.data.number;
+							if (context->lineNum < from) SAFE_POINT();
+						}
+					}
+				}
+				NEXT();
+				
+				HANDLER(GotoAifB_Num)
+				HANDLER(GotoAifNotB_Num) {
+					// (Target is known to be a constant number, or we wouldn't be here.)
+					Value opB = OPERAND_B;
+					if (opB.type != ValueType::Number) {
+						inst->op = GenericOp(inst->op);
+						goto redispatch;
+					}
+					if ((opB.data.number != 0) == (inst->op == TACLine::Op::GotoAifB_Num)) {
+						long from = context->lineNum;
+						context->lineNum = (long)bc->constants[inst->a].data.number;
+						if (context->lineNum < from) SAFE_POINT();
+					}
+				}
+				NEXT();
+				
+				COMPARE_BRANCH_HANDLER(AEqualB_Branch, AEqualB, ==)
+				COMPARE_BRANCH_HANDLER(ANotEqualB_Branch, ANotEqualB, !=)
+				COMPARE_BRANCH_HANDLER(AGreaterThanB_Branch, AGreaterThanB, >)
+				COMPARE_BRANCH_HANDLER(AGreatOrEqualB_Branch, AGreatOrEqualB, >=)
+				COMPARE_BRANCH_HANDLER(ALessThanB_Branch, ALessThanB, <)
+				COMPARE_BRANCH_HANDLER(ALessOrEqualB_Branch, ALessOrEqualB, <=)
+				
+				HANDLER(ForNext) {
+					// Does the work of these five instructions (see FuseSuperinstructions):
+					//	idx := idx + 1
+					//	_t1 := len(seq)
+					//	_t2 := idx >= _t1
+					//	goto END if _t2
+					//	var := seq iter idx
+					Instruction *lenInst = inst + 1;
+					Instruction *branch = inst + 3;
+					Instruction *iterInst = inst + 4;
+					Value idx = OPERAND_A;
+					if (idx.type == ValueType::Number) idx = Value(idx.data.number + 1);
+					else idx = TACLine::Evaluate(TACLine::Op::APlusB, idx, OPERAND_B, context);
+					STORE_LHS(idx);
+					Value seq = FetchOperand(lenInst->aKind, lenInst->a, bc, context);
+					Value len = (seq.type == ValueType::List ? Value(seq.GetList().Count())
+								 : TACLine::Evaluate(TACLine::Op::LengthOfA, seq, Value::null, context));
+					bool done;
+					if (idx.type == ValueType::Number and len.type == ValueType::Number) {
+						done = (idx.data.number >= len.data.number);
+					} else {
+						Value result = TACLine::Evaluate(TACLine::Op::AGreatOrEqualB, idx, len, context);
+						done = (!result.IsNull() and result.BoolValue());
+					}
+					if (done) {
+						long from = context->lineNum;
+						context->lineNum = (long)bc->constants[branch->a].data.number;
+						if (context->lineNum < from) SAFE_POINT();
+					} else {
+						Value item;
+						if (seq.type == ValueType::List and idx.type == ValueType::Number) item = seq.GetElem(idx);
+						else if (seq.type == ValueType::Map) item = NextKeyValuePair(seq, idx, iterInst->lhsKind, iterInst->lhs, bc, context);
+						else item = TACLine::Evaluate(TACLine::Op::ElemBofIterA, seq, idx, context);
+						StoreOperand(iterInst->lhsKind, iterInst->lhs, bc, context, item);
+						context->lineNum += 4;
+					}
+				}
+				NEXT();
+				
+				HANDLER(PushParam) {
+					context->PushParamArgument(OPERAND_A);
+				}
+				NEXT();
+				
+				HANDLER(CallFunctionA) {
+					DoOneInstruction(*inst, bc, context);
+					if (stack.Last() != context) {
+						SAFE_POINT();
+						goto loadFrame;
+					}
+				}
+				NEXT();
+				
+				HANDLER(CallFunctionA_Value) {
+					Value val = OPERAND_A;
+					if (val.type == ValueType::Function) {
+						inst->op = TACLine::Op::CallFunctionA;
+						goto redispatch;
+					}
+					STORE_LHS(val);
+				}
+				NEXT();
+				
+				HANDLER(CallIntrinsicA) {
+					// The intrinsic may push a call (e.g. import), or even stop
+					// the machine and delete our context (e.g. exit).
+					depth = stack.Count();
+					{
+						Value result = EvaluateInstruction(*inst, bc, context);
+						if (stack.Count() < depth or stack[depth-1] != context) goto loadFrame;
+						STORE_LHS(result);
+					}
+					if (yielding) goto stop;
+					if (returnEarly and not stack.Last()->partialResult.Done()) goto stop;
+					SAFE_POINT();
+					if (stack.Count() != depth) goto loadFrame;
+				}
+				NEXT();
+				
+				HANDLER(ReturnA) {
+					DoOneInstruction(*inst, bc, context);
+					if (returnEarly and not stack.Last()->partialResult.Done()) goto stop;
+					goto loadFrame;
+				}
+			}
+			// (Not reached unless the op is not valid.)
+			NEXT();
+
+		frameDone:
+			// Ran off the end of the current context; pop it (unless it's the global one).
+			if (stack.Count() == 1) goto stop;
+			PopContext();
+			goto loadFrame;
+			
+		} catch (MiniscriptException& mse) {
+			if (inst) mse.location = bc->GetSourceLoc(inst - bc->code);
+			if (bc) bc->release();
+			throw;
 		}
+		
+	stop:
+		if (bc) bc->release();
+		
+		#undef OPERAND_A
+		#undef OPERAND_B
+		#undef STORE_LHS
+		#undef FETCH
+		#undef SAFE_POINT
+		#undef HANDLER
+		#undef NEXT
+		#undef NUMERIC_HANDLER
+		#undef GENERIC_HANDLER
+		#undef COMPARE_BRANCH_HANDLER
 	}
 
 	void Machine::PopContext() {
@@ -749,7 +1526,7 @@ namespace MiniScript {
 		Context* context = stack.Pop();
 		Value result = context->GetTemp(0, Value::null);
 		Value storage = context->resultStorage;
-		delete context;
+		RecycleContext(context);
 		context = stack.Last();
 		context->StoreValue(storage, result);
 	}
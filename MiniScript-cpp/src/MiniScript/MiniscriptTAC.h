@@ -18,10 +18,12 @@ namespace MiniScript {
 	class Machine;
 	class IntrinsicResult;
 	class Interpreter;
+	class Bytecode;
+	class Instruction;
 	
 	class TACLine {
 	public:
-		enum class Op {
+		enum class Op : unsigned char {
 			Noop = 0,
 			AssignA,
 			AssignImplicit,
@@ -54,7 +56,33 @@ namespace MiniScript {
 			ReturnA,
 			ElemBofA,
 			ElemBofIterA,
-			LengthOfA
+			LengthOfA,
+			
+			// Quickened forms of the ops above.  These never appear in TAC; the
+			// machine substitutes them into Bytecode once it has seen what types of
+			// operands an instruction gets.  Each one checks that its operands are
+			// still of those types, and if not, reverts to the generic op.
+			CallFunctionA_Value,	// CallFunctionA (no args) of something not a function
+			GotoAifB_Num,			// GotoAifB with a numeric B
+			GotoAifNotB_Num,		// GotoAifNotB with a numeric B
+			ElemBofA_ListNum,		// ElemBofA with a list A and numeric B
+			ElemBofA_MapStr,		// ElemBofA with a map A and string B
+			ElemBofIterA_ListNum,	// ElemBofIterA with a list A and numeric B
+			LengthOfA_List,			// LengthOfA with a list A
+
+			// Superinstructions.  These don't appear in TAC either; when lowering
+			// to Bytecode, the first instruction of a common sequence is replaced
+			// with one of these, which does the work of the whole sequence (reading
+			// the operands of the instructions after it, which are left in place).
+			// Its generic op is the first op of the sequence, so the sequence can
+			// still be run one instruction at a time (e.g. by Machine::Step).
+			AEqualB_Branch,			// AEqualB into a temp, then GotoAifB or GotoAifNotB on it
+			ANotEqualB_Branch,		// ANotEqualB into a temp, then GotoAifB or GotoAifNotB on it
+			AGreaterThanB_Branch,	// AGreaterThanB into a temp, then GotoAifB or GotoAifNotB on it
+			AGreatOrEqualB_Branch,	// AGreatOrEqualB into a temp, then GotoAifB or GotoAifNotB on it
+			ALessThanB_Branch,		// ALessThanB into a temp, then GotoAifB or GotoAifNotB on it
+			ALessOrEqualB_Branch,	// ALessOrEqualB into a temp, then GotoAifB or GotoAifNotB on it
+			ForNext					// the five-instruction step of a 'for' loop, starting with APlusB
 		};
 		
 		Value lhs;
@@ -70,42 +98,63 @@ namespace MiniScript {
 
 		String ToString();
 		Value Evaluate(Context *context);
+
+		/// <summary>
+		/// Evaluate the given (non-assignment, non-call) operation on operands
+		/// that have already been fetched.  This is the part of Evaluate that
+		/// does not depend on the form in which the operands were stored.
+		/// </summary>
+		static Value Evaluate(Op op, Value opA, Value opB, Context *context);
 	};
 		
 	class Context {
 	public:
 		List<TACLine> code;			// TAC lines we're executing
+		Bytecode *bytecode;			// compiled form of code (may be shared with our function)
 		long lineNum;				// next line to be executed
-		ValueDict variables;		// local variables for this call frame
+		ValueDict variables;		// local variables for this call frame (other than those in slots)
+		Value *slots;				// local variables resolved to slots by our bytecode (or nullptr)
 		ValueDict outerVars;		// variables of the context where this function was defined
 		ValueList args;				// pushed arguments for upcoming calls
 		Context *parent;			// parent (calling) context
+		Context *root;				// global context at the bottom of the call chain (nullptr if that's us)
 		Value resultStorage;		// where to store the return value (in the calling context)
 		Machine *vm;				// virtual machine
 		IntrinsicResult partialResult;	// work-in-progress of our current intrinsic
 		long implicitResultCounter;	// how many times we have stored an implicit result
 		
-		Context() : lineNum(0), parent(nullptr), vm(nullptr), implicitResultCounter(0) {}
+		Context() : bytecode(nullptr), lineNum(0), slots(nullptr), parent(nullptr), root(nullptr), vm(nullptr), implicitResultCounter(0),
+			slotBuffer(nullptr), slotCapacity(0) {}
+		~Context();
 		
 		bool Done() { return lineNum >= code.Count(); }
 
-		Context* Root() {
-			Context* c = this;
-			while (c->parent != nullptr) c = c->parent;
-			return c;
-		}
+		Context* Root() { return root ? root : this; }
 		
         void ClearCodeAndTemps() {
             code.Clear();
             lineNum = 0;
             temps.Clear();
+            DiscardBytecode();
         }
+
+		/// <summary>
+		/// Make sure our bytecode is up to date with our TAC code, compiling
+		/// it if needed (e.g. because the REPL has appended more lines).
+		/// </summary>
+		void CompileIfNeeded();
+		
+		/// <summary>
+		/// Release our compiled bytecode, so it will be recompiled from code
+		/// the next time we need it.
+		/// </summary>
+		void DiscardBytecode();
         
 		void StoreValue(Value lhs, Value value);
 
 		void SetTemp(int tempNum, Value value) {
-			while (temps.Count() <= tempNum) temps.Add(Value::null);
-			temps[tempNum] = value;
+			if (temps.Count() <= tempNum) temps.Resize(tempNum + 1);
+			temps[tempNum] = std::move(value);
 		}
 		
 		Value GetTemp(int tempNum) { return temps.Count() ? temps[tempNum] : Value::null; }
@@ -114,9 +163,33 @@ namespace MiniScript {
 			if (tempNum < temps.Count()) return temps[tempNum];
 			return defaultValue;
 		}
+		
+		/// <summary>
+		/// Clear any temps that refer to the same object as the given value, other
+		/// than those holding the sequence of a 'for' loop.  This must be done only
+		/// where no other temps are still to be read: between statements, or in an
+		/// instruction that stores into a variable.  (Compiled code stores into a
+		/// variable only as the last step of an assignment statement, or of the
+		/// bookkeeping at the top of a 'for' loop, where only the sequence temp is
+		/// in use; see StoresToVariable in MiniscriptTAC.cpp.)
+		/// </summary>
+		void ReleaseDeadTemps(const Value& value);
 	
-		void SetVar(String identifier, Value value);
-		Value GetVar(String identifier, LocalOnlyMode localOnly=LocalOnlyMode::Off);
+		void SetVar(const String& identifier, Value value);
+		Value GetVar(const String& identifier, LocalOnlyMode localOnly=LocalOnlyMode::Off);
+		
+		/// <summary>
+		/// Look up an identifier that is not a local variable of this context
+		/// (or is a local that has not been assigned yet), in the outer, global,
+		/// and intrinsic scopes.  Raise an exception if it can't be found.
+		/// </summary>
+		Value GetNonlocalVar(String identifier, LocalOnlyMode localOnly=LocalOnlyMode::Off);
+		
+		/// <summary>
+		/// Return whether the given slot value means "not assigned yet".  (Temps
+		/// are never stored in variables, so a Temp is used for this.)
+		/// </summary>
+		static bool IsUnassigned(const Value& slotValue) { return slotValue.type == ValueType::Temp; }
 		
 		/// <summary>
 		/// Store a parameter argument in preparation for an upcoming call
@@ -139,12 +212,21 @@ namespace MiniScript {
 		/// <param name="resultStorage">Value to stuff the result into when done.</param>
 		Context* NextCallContext(FunctionStorage *func, long argCount, bool gotSelf, Value resultStorage);
 
+		/// <summary>
+		/// Release everything this context refers to (code, variables, temps,
+		/// arguments, etc.), but keep its buffers, so that the machine can
+		/// reuse it for another call.
+		/// </summary>
+		void ResetForReuse();
+
 		void JumpToEnd() { lineNum = code.Count(); }
 		
 		SourceLoc GetSourceLoc();
 		
 	private:
 		List<Value> temps;			// values of temporaries; temps[0] is always return value
+		Value *slotBuffer;			// storage for slots, which may be bigger than our bytecode needs
+		long slotCapacity;			// number of Values allocated in slotBuffer (all unassigned when not in use)
 	};
 	
 	class Machine {
@@ -155,10 +237,32 @@ namespace MiniScript {
 		
 		bool Done() { return stack.Count() <= 1 and stack.Last()->Done(); }
 		void Step();
+		
+		/// <summary>
+		/// Run many instructions at once, until the machine is done, a yield
+		/// is requested, or the given time limit (in seconds) runs out.  If
+		/// returnEarly is true, also return as soon as an intrinsic reports a
+		/// partial result (i.e. is waiting for something).  The time limit is
+		/// checked only at safe points (backward jumps and calls), so this may
+		/// run slightly past the limit.
+		/// </summary>
+		void Run(double timeLimit, bool returnEarly);
 		void Stop();
 		void Reset();
 		void ManuallyPushCall(FunctionStorage* func, Value resultStorage=Value::null);
 
+		/// <summary>
+		/// Get an empty context for a new call frame, reusing a previously
+		/// popped one if available (which saves reallocating its buffers).
+		/// </summary>
+		Context* AcquireContext();
+		
+		/// <summary>
+		/// Dispose of a context that has been popped off the stack, keeping it
+		/// for reuse by AcquireContext (up to a limit).
+		/// </summary>
+		void RecycleContext(Context *context);
+
 		Context* GetGlobalContext() { return stack[0]; }
 		Context* GetTopContext() { return stack.Last(); }
 		String FindShortName(const Value& val);
@@ -181,10 +285,12 @@ namespace MiniScript {
 	private:
 		static double CurrentWallClockTime();
 		
-		void DoOneLine(TACLine& line, Context *context);
+		void DoOneInstruction(Instruction& inst, Bytecode *bc, Context *context);
 		void PopContext();
 		
 		List<Context*> stack;
+		List<Context*> freeContexts;	// popped contexts, ready for reuse
+		static const long maxFreeContexts = 64;
 		double startTime;		// value of CurrentWallClockTime() when machine began its run
 	};
 }
@@ -10,6 +10,7 @@
 #include "MiniscriptErrors.h"
 #include "MiniscriptIntrinsics.h"
 #include "MiniscriptTAC.h"
+#include "MiniscriptBytecode.h"
 #include "UnitTest.h"
 #include "SplitJoin.h"
 
@@ -42,9 +43,48 @@ namespace MiniScript {
 		result->parameters = parameters;
 		result->code = code;
 		result->outerVars = contextVariables;
+		result->intrinsic = intrinsic;
+		result->bytecode = GetBytecode();		// (compile once, share among all copies)
+		result->bytecode->retain();
 		return result;
 	}
 
+	FunctionStorage::FunctionStorage() : intrinsic(nullptr), bytecode(nullptr) {}
+
+	FunctionStorage::~FunctionStorage() {
+		if (bytecode) bytecode->release();
+	}
+
+	void FunctionStorage::VisitChildren(Visitor visit, void *data) {
+		// (An empty map refers to nothing, so can't be part of a cycle; and
+		// checking for that first keeps us from making storage for it here.)
+		if (outerVars.Count() > 0) VisitCollectable(Value(outerVars), visit, data);
+	}
+
+	void FunctionStorage::ClearChildren() {
+		outerVars.Detach();
+	}
+
+	void VisitCollectable(const Value& value, CollectableStorage::Visitor visit, void *data) {
+		switch (value.type) {
+			case ValueType::List:
+			case ValueType::Map:
+			case ValueType::Function:
+				if (value.data.ref) visit(static_cast<CollectableStorage*>(value.data.ref), data);
+				break;
+			default:
+				break;
+		}
+	}
+
+	Bytecode *FunctionStorage::GetBytecode() {
+		if (bytecode == nullptr or bytecode->count != code.Count()) {
+			if (bytecode) bytecode->release();
+			bytecode = Bytecode::Lower(code, this);
+		}
+		return bytecode;
+	}
+
 	
 	String ToString(ValueType type) {
 		switch (type) {
@@ -403,6 +443,12 @@ namespace MiniScript {
 			list[i] = value;
 		} else if (type == ValueType::Map) {
 			ValueDict dict = GetDict();
+			// Use the interned copy of a string key if there is one, so that many
+			// maps with the same keys don't each keep their own copy of them.
+			if (index.type == ValueType::String and index.data.ref
+					and not ((StringStorage*)index.data.ref)->interned) {
+				index = String::LookupInterned(index.GetString());
+			}
 			if (!dict.ApplyAssignOverride(index, value)) {
 				dict.SetValue(index, value);
 			}
@@ -624,24 +670,54 @@ namespace MiniScript {
 		if (index < 0) IndexException(String("index " ) + String::Format(index) + " out of range for map").raise();
 		if (map.type != ValueType::Map) return Value::null;
 		ValueDict dict = map.GetDict();
-		// For now, we'll just iterate from the beginning every time.  This is horribly
-		// inefficient on big maps (and not great even on small ones).  OFI: Optimize.
-		long i = 0;
-		for (ValueDictIterator iter = dict.GetIterator(); !iter.Done(); iter.Next()) {
-			if (i == index) {
-				// Found the requested entry.  Convert to its own little map.
-				ValueDict result;
-				result.SetValue(Value::keyString, iter.Key());
-				result.SetValue(Value::valueString, iter.Value());
-//				dict.forget();
-				return Value(result);
+		if (index >= dict.Count()) {
+			IndexException(String("index " ) + String::Format(index) + " out of range for map").raise();
+		}
+		// Convert the requested entry to its own little map.
+		return MakeKeyValuePair(dict.KeyAt(index), dict.ValueAt(index));
+	}
+
+	void Value::AppendString(const String& s) {
+		Assert(type == ValueType::String);
+		if (s.empty()) return;
+		// Hand our reference over to a String, so that (if it was the only one)
+		// the String sees its storage as unshared, and can append in place.
+		String str((StringStorage*)data.ref, false);
+		try {
+			str.Append(s);
+		} catch (...) {
+			str.forget();		// (it failed, so our reference is unchanged)
+			throw;
+		}
+		data.ref = str.ss;
+		str.forget();
+	}
+
+	/// <summary>
+	/// Make a map containing the given "key" and "value".  But if *reuse is such
+	/// a map (e.g. from the previous iteration of a "for" loop), and nothing else
+	/// refers to it, just update and return that one instead of making a new map.
+	/// </summary>
+	/// <param name="reuse">where the previous key/value pair is stored, or nullptr</param>
+	Value Value::MakeKeyValuePair(const Value& key, const Value& value, Value *reuse) {
+		if (reuse and reuse->type == ValueType::Map) {
+			DictionaryStorage<Value, Value> *storage = (DictionaryStorage<Value, Value>*)reuse->data.ref;
+			if (storage and storage->refCount == 1 and storage->mSize == 2
+					and storage->assignOverride == nullptr and storage->evalOverride == nullptr) {
+				ValueDict pair(storage);
+				Value *keyPtr = pair.GetValuePointer(Value::keyString);
+				Value *valuePtr = pair.GetValuePointer(Value::valueString);
+				if (keyPtr and valuePtr) {
+					*keyPtr = key;
+					*valuePtr = value;
+					return *reuse;
+				}
 			}
-			i++;
 		}
-		// Out of bounds (index too high).
-//		dict.forget();
-		IndexException(String("index " ) + String::Format(index) + " out of range for map").raise();
-		return Value::null;
+		ValueDict result;
+		result.SetValue(Value::keyString, key);
+		result.SetValue(Value::valueString, value);
+		return Value(result);
 	}
 
 	unsigned int HashValue(const Value& v) {
@@ -663,9 +739,14 @@ namespace MiniScript {
 				
 			case ValueType::Number:
 			{
-				// Not sure how to hash doubles... for now, we'll just do:
-				int i = data.number;
-				return IntHash(i);
+				// Hash all the bits of the double, so that (for example) 0.1 and 0.2,
+				// or 1E12 and 1E12+1, hash differently.  Equal numbers have the same
+				// bits, except for 0 and -0, so make sure those hash the same.
+				double d = data.number;
+				if (d == 0) d = 0;
+				unsigned long long bits;
+				memcpy(&bits, &d, sizeof(bits));
+				return hashBits64(bits ^ hashSeed);
 			}
 				
 			case ValueType::String:
@@ -691,7 +772,7 @@ namespace MiniScript {
 				return IntHash(data.tempNum);
 			
 			case ValueType::Function:
-				return IntHash((int)(long)data.ref);
+				return hashBits64((unsigned long long)data.ref);
 
 			case ValueType::SeqElem:
 			{
@@ -701,7 +782,7 @@ namespace MiniScript {
 			} break;
 				
 			case ValueType::Handle:
-				return IntHash((int)(long)data.ref);
+				return hashBits64((unsigned long long)data.ref);
 		}
 		return 0;
 	}
@@ -905,6 +986,16 @@ void TestValue::TestBasics()
 	Assert(a.type == ValueType::List);
 	String s = a.ToString(nullptr);
 	Assert(s == "[1, \"two\", 3.14157]");
+	
+	// Moving a value hands over its reference, leaving the original null.
+	Value d(std::move(a));
+	Assert(a.IsNull() and d.type == ValueType::List and d.GetList().Count() == 3);
+	b = std::move(d);
+	Assert(d.IsNull() and b.ToString(nullptr) == s);
+	Value e(String("mo") + "ved");
+	String t = e.GetString();
+	String u(std::move(t));
+	Assert(t.empty() and u == "moved" and e.GetString() == "moved");
 }
 
 void TestValue::TestHashAndEquality() {
@@ -917,6 +1008,12 @@ void TestValue::TestHashAndEquality() {
 	Assert(a != b);
 	Assert(!(a == b));
 	
+	// Numbers hash by all their bits, not just their integer part.
+	Assert(Value(0.1).Hash() != Value(0.2).Hash());
+	Assert(Value(1E12).Hash() != Value(1E12 + 0.5).Hash());
+	Assert(Value(0.0).Hash() == Value(-0.0).Hash());
+	Assert(Value(1).Hash() == Value(1.0).Hash());
+	
 	a = Value(String("Hello") + " Bob");
 	b = String("Hell") + "o Bob";
 	Assert(a.Hash() == b.Hash());
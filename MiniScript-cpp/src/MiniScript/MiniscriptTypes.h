@@ -14,6 +14,7 @@
 #include "Dictionary.h"
 
 #include <cstdint>
+#include <utility>
 
 namespace MiniScript {
 	
@@ -22,8 +23,19 @@ namespace MiniScript {
 	class FuncParam;
 	class TACLine;
 	class Value;
+
+	// Lists and maps of Value can refer to each other (and to functions), so
+	// they can form reference cycles; their storage is collectable.
+	template <> struct ListStorageBase<Value> { typedef CollectableStorage Type; };
+	template <> struct DictionaryStorageBase<Value, Value> { typedef CollectableStorage Type; };
+
+	// Call the given visitor on the storage of the given value, if it's a list, map, or function.
+	void VisitCollectable(const Value& value, CollectableStorage::Visitor visit, void *data);
+
 	class Context;
 	class Machine;
+	class Bytecode;
+	class Intrinsic;
 	
 	unsigned int HashValue(const Value& v);
 	
@@ -39,7 +51,7 @@ namespace MiniScript {
 	/// actually HAVE names; instead there are named variables whose value may happen to be
 	/// a function.)
 	/// </summary>
-	class FunctionStorage : public RefCountedStorage {
+	class FunctionStorage : public CollectableStorage {
 	public:
 		// Function parameters
 		List<FuncParam> parameters;
@@ -50,7 +62,28 @@ namespace MiniScript {
 		// Local variables where the function was defined {#8}
 		ValueDict outerVars;
 		
+		// If this is the wrapper function for an intrinsic, that intrinsic
+		Intrinsic *intrinsic;
+		
+		FunctionStorage();
+		virtual ~FunctionStorage();
+		
 		FunctionStorage *BindAndCopy(ValueDict contextVariables);
+		
+		/// <summary>
+		/// Get the compiled form of our code, lowering it on first use (or
+		/// whenever the code has changed since then).  The result is owned by
+		/// this function; retain it if you need to keep it.
+		/// </summary>
+		Bytecode *GetBytecode();
+		
+		// cycle collection support: we refer to our outer variables
+		virtual void VisitChildren(Visitor visit, void *data);
+		virtual void ClearChildren();
+		virtual Kind CollectableKind() const { return Kind::Function; }
+
+	private:
+		Bytecode *bytecode;		// compiled code, shared by all bound copies of this function
 	};
 
 	class SeqElemStorage;
@@ -99,6 +132,19 @@ namespace MiniScript {
 		Value(const String& s) : type(ValueType::String), noInvoke(false), localOnly(LocalOnlyMode::Off) { data.ref = (s.ss ? s.ss : emptyString.data.ref);	retain(); }
 		Value(const ValueList& l) : type(ValueType::List), noInvoke(false), localOnly(LocalOnlyMode::Off) { ((ValueList&)l).ensureStorage(); data.ref = l.ls; retain(); }
 		Value(const ValueDict& d) : type(ValueType::Map), noInvoke(false), localOnly(LocalOnlyMode::Off) { ((ValueDict&)d).ensureStorage(); data.ref = d.ds; retain(); }
+		// (and from temporaries, whose reference we can take over instead)
+		Value(String&& s) : type(ValueType::String), noInvoke(false), localOnly(LocalOnlyMode::Off) {
+			if (s.ss and not s.isTemp) { data.ref = s.ss; s.forget(); }
+			else { data.ref = (s.ss ? s.ss : emptyString.data.ref); retain(); }
+		}
+		Value(ValueList&& l) : type(ValueType::List), noInvoke(false), localOnly(LocalOnlyMode::Off) {
+			l.ensureStorage(); data.ref = l.ls;
+			if (l.isTemp) retain(); else l.forget();
+		}
+		Value(ValueDict&& d) : type(ValueType::Map), noInvoke(false), localOnly(LocalOnlyMode::Off) {
+			d.ensureStorage(); data.ref = d.ds;
+			if (d.isTemp) retain(); else d.forget();
+		}
 		Value(FunctionStorage *s) : type(ValueType::Function), noInvoke(false), localOnly(LocalOnlyMode::Off) { data.ref = s; }
 		Value(SeqElemStorage *s);
 
@@ -111,6 +157,7 @@ namespace MiniScript {
 		static Value Truth(double b);
 
 		static Value GetKeyValuePair(Value map, long index);
+		static Value MakeKeyValuePair(const Value& key, const Value& value, Value *reuse=nullptr);
 		
 		// copy-ctor, assignment-op, destructor
 		Value(const Value &other) : type(other.type), noInvoke(other.noInvoke), localOnly(other.localOnly) {
@@ -126,6 +173,27 @@ namespace MiniScript {
 			data = other.data;
 			return *this;
 		}
+		// move-ctor and move-assignment-op (which leave the other value null)
+		Value(Value &&other) noexcept : type(other.type), noInvoke(other.noInvoke), localOnly(other.localOnly) {
+			data = other.data;
+			other.type = ValueType::Null;
+		}
+		Value& operator= (Value&& other) noexcept {
+			if (this == &other) return *this;
+			// (Take the other's value before releasing ours, in case that releases
+			// whatever holds the other.)
+			ValueType otherType = other.type;
+			bool otherNoInvoke = other.noInvoke;
+			LocalOnlyMode otherLocalOnly = other.localOnly;
+			decltype(data) otherData = other.data;
+			other.type = ValueType::Null;
+			if (usesRef()) release();
+			type = otherType;
+			noInvoke = otherNoInvoke;
+			localOnly = otherLocalOnly;
+			data = otherData;
+			return *this;
+		}
 		inline ~Value() { if (usesRef()) release(); }
 
 		// conversions
@@ -147,6 +215,10 @@ namespace MiniScript {
 			return String(ss, false); }
 		ValueList GetList() const { Assert(type == ValueType::List); ValueList l((ValueListStorage*)(data.ref), false); return l; }
 		ValueDict GetDict() { Assert(type == ValueType::Map); if (not data.ref) data.ref = new ValueDictStorage(); ValueDict d((ValueDictStorage*)(data.ref)); d.retain(); return d; }
+		
+		// Append to this string value, in place if nothing else refers to its
+		// storage (see String::AppendB).
+		void AppendString(const String& s);
 
 		// evaluation
 		bool IsNull() const {
@@ -311,7 +383,7 @@ namespace MiniScript {
 
 	bool Value::RefEquals(const Value& rhs) const {
 		if (!usesRef()) return *this == rhs;
-		return data.ref == rhs.data.ref;
+		return rhs.type == type and data.ref == rhs.data.ref;	// (rhs may be null, with no ref at all)
 	}
 	
 	/// <summary>
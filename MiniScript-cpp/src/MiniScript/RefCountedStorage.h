@@ -5,11 +5,21 @@
 //  Created by Joe Strout on 6/1/18.
 //  Copyright © 2018 Joe Strout. All rights reserved.
 //
+//	Define MINISCRIPT_COUNT_RETAINS as 1 to count the calls to retain and
+//	release (on each thread), e.g. to see how much reference-count traffic
+//	some change saves.  The counts are in RefCountedStorage::retainCount and
+//	releaseCount, and the command-line tool prints them on exit.
+//
 
 #ifndef REFCOUNTEDSTORAGE_H
 #define REFCOUNTEDSTORAGE_H
 
 #include <stdio.h>
+#include "MemoryAccount.h"
+
+#ifndef MINISCRIPT_COUNT_RETAINS
+	#define MINISCRIPT_COUNT_RETAINS 0
+#endif
 
 namespace MiniScript {
 
@@ -19,10 +29,29 @@ extern long _stringInstanceCount();
 
 	class RefCountedStorage {
 	public:
+#if MINISCRIPT_COUNT_RETAINS
+		void retain() { retainCount++; refCount++; }
+		void release() { releaseCount++; if (--refCount == 0) Destroy(); }
+
+		static thread_local long long retainCount;
+		static thread_local long long releaseCount;
+#else
 		void retain() { refCount++; }
-		void release() { if (--refCount == 0) delete this; }
+		void release() { if (--refCount == 0) Destroy(); }
+#endif
 		
+		// Storage comes from the MemoryPool, and is charged to the current
+		// MemoryAccount.  (The size given to delete is that of the actual
+		// object, as our destructor is virtual.)
+		static void *operator new(size_t size) { MemoryAccount::Charge(size); return MemoryPool::Allocate(size); }
+		static void operator delete(void *p, size_t size) { MemoryAccount::Credit(size); MemoryPool::Free(p, size); }
+
 	protected:
+		// Destroy and free this object, once nothing refers to it any more.
+		// (Subclasses that allocate themselves some other way override this.)
+		virtual void Destroy() { delete this; }
+
+
 		RefCountedStorage() : refCount(1) {
 #if(DEBUG)
 			instanceCount++;
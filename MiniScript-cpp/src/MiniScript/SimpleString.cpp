@@ -3,6 +3,7 @@
  *
  */
 #include "SimpleString.h"
+#include "Dictionary.h"
 #include "UnicodeUtil.h"
 #include "UnitTest.h"
 #include <stdio.h>
@@ -10,6 +11,72 @@
 
 namespace MiniScript {
 
+	unsigned long long hashSeed = 0;
+
+	// Each thread has its own intern table (as reference counts aren't atomic,
+	// threads mustn't share strings), mapping each interned string to itself.
+	// Strings that only the table refers to are dropped whenever it has grown
+	// to twice what was left after the last time.  (It's made on first use,
+	// so that we don't depend on static initialization order.)
+	struct InternTable {
+		static const long minPurgeCount = 1024;
+		static const long tableRefs = 2;	// (references the table holds, as key and as value)
+		Dictionary<String, String, hashString> strings;
+		long purgeAt = minPurgeCount;
+	};
+	static InternTable& Interned() {
+		static thread_local InternTable table;
+		return table;
+	}
+	
+	String String::Intern(const String& s) {
+		if (!s.ss or s.ss->dataSize <= 1 or s.ss->interned) return s;
+		InternTable& table = Interned();
+		String result;
+		if (table.strings.Get(s, &result)) return result;
+		// Interned strings are shared by all interpreters on this thread, so
+		// they're not charged to any (or limited by any).
+		MemoryAccount::Credit(s.ss->AllocatedSize());
+		MemoryAccount::Unaccounted unaccounted;
+		s.Hash();		// (computed now, so it's always cached)
+		s.ss->interned = true;
+		table.strings.SetValue(s, s);
+		if (table.strings.Count() >= table.purgeAt) PurgeInterned();
+		return s;
+	}
+	
+	String String::ASCIIChar(char c) {
+		static thread_local String table[128];
+		String& result = table[c & 0x7F];
+		if (!result.ss) result = Intern(String((char)(c & 0x7F)));
+		return result;
+	}
+	
+	String String::LookupInterned(const String& s) {
+		if (!s.ss or s.ss->interned) return s;
+		String result;
+		if (Interned().strings.Get(s, &result)) return result;
+		return s;
+	}
+
+	void String::PurgeInterned() {
+		MemoryAccount::Unaccounted unaccounted;
+		InternTable& table = Interned();
+		List<String> unused;
+		for (DictIterator<String, String> kv = table.strings.GetIterator(); !kv.Done(); kv.Next()) {
+			String key = kv.Key();		// (which is one more reference)
+			if (key.ss->refCount <= InternTable::tableRefs + 1) unused.Add(key);
+		}
+		for (long i=0; i<unused.Count(); i++) table.strings.Remove(unused[i]);
+		table.purgeAt = table.strings.Count() * 2;
+		if (table.purgeAt < InternTable::minPurgeCount) table.purgeAt = InternTable::minPurgeCount;
+	}
+
+#if MINISCRIPT_COUNT_RETAINS
+	thread_local long long RefCountedStorage::retainCount = 0;
+	thread_local long long RefCountedStorage::releaseCount = 0;
+#endif
+
 #if(DEBUG)
 	long RefCountedStorage::instanceCount = 0;
 	long StringStorage::instanceCount = 0;
@@ -70,8 +137,9 @@ namespace MiniScript {
 
 	String String::Substring(long pos, long numChars) const {
 		if (!ss) return *this;
-		long posB = bytePosOfCharPos(pos);	// (also ensures ss->isASCII is known)
+		if (ss->charCount < 0) ss->analyzeChars();
 		if (ss->isASCII) return SubstringB(pos, numChars);
+		long posB = bytePosOfCharPos(pos);
 		unsigned char *startPtr = (unsigned char*)ss->data + posB;
 		unsigned char *endPtr = startPtr;
 		unsigned char *max = (unsigned char*)ss->data + ss->dataSize;
@@ -339,6 +407,54 @@ namespace MiniScript {
 		Assert(not s.StartsWith("本語"));
 		Assert(s.EndsWith("本語"));
 		Assert(not s.EndsWith("本"));
+		
+		// Hashes are cached, and equal strings hash (and compare) equal however made.
+		String h1 = String("hash") + "Me";
+		String h2 = String("xhashMe").Substring(1);
+		Assert(h1.Hash() == h1.Hash() and h1.Hash() == h2.Hash() and h1 == h2);
+		Assert(h1 != String("hashMx") and h1 != String("hashMe!"));
+		Assert(String("").Hash() == String().Hash() and String("") == String());
+		Assert(String("abcdefgh12345").Hash() != String("abcdefgh12346").Hash());
+		
+		// Interning gives the same storage for the same contents.
+		String i1 = String::Intern(String("inter") + "ned");
+		String i2 = String::Intern(String("xinterned").Substring(1));
+		Assert(i1.IsInterned() and i1.c_str() == i2.c_str() and i1 == i2);
+		Assert(String::LookupInterned(String("inte") + "rned").c_str() == i1.c_str());
+		String other = String("not") + " interned";
+		Assert(String::LookupInterned(other).c_str() == other.c_str() and not other.IsInterned());
+		Assert(i1 != String::Intern("interned2") and String::Intern("interned") == i1);
+		
+		// Purging drops interned strings that nothing else refers to, and only those.
+		{
+			String unused = String::Intern(String("unused") + "Name");
+		}
+		String::PurgeInterned();
+		Assert(not String::LookupInterned(String("unusedName")).IsInterned());
+		Assert(String::LookupInterned(String("inte") + "rned").c_str() == i1.c_str());
+		
+		// Appending adds in place to a string nothing else refers to,
+		// but never changes one that's shared.
+		String built = String("ab") + "c";
+		String shared = built;
+		built += "d";
+		Assert(shared == "abc" and built == "abcd");
+		built.AppendB("efgh", 2);
+		const char *before = built.c_str();
+		built += "g";
+		Assert(built == "abcdefg" and built.c_str() == before and built.Length() == 7);
+		
+		// Repeated-character strings are exactly as long as asked for.
+		Assert(String(3, 'x') == "xxx" and String(3, 'x').LengthB() == 3);
+		
+		// One-character ASCII substrings are shared rather than allocated.
+		String word("wow");
+		Assert(word.Substring(0, 1).c_str() == word.SubstringB(2, 1).c_str());
+		Assert(word.Substring(1, 1) == "o" and word.Substring(1, 1).IsInterned());
+		Assert(String::Intern("w").c_str() == String::ASCIIChar('w').c_str());
+		
+		// Substrings of a fresh string count characters, not bytes, from the start too.
+		Assert(String("\xC3\xA9t\xC3\xA9").Substring(0, 2) == "\xC3\xA9t");
 	}
 
 	RegisterUnitTest(TestString);
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <cctype>
 #include <cstring>
+#include <new>
+#include <utility>
 #include "RefCountedStorage.h"
 
 namespace MiniScript {
@@ -24,7 +26,7 @@ namespace MiniScript {
 
 	class StringStorage : public RefCountedStorage {
 	private:
-		StringStorage() : data(nullptr), dataSize(0), charCount(-1) {
+		StringStorage() : data(nullptr), dataSize(0), capacity(0), charCount(-1), isASCII(false), hashKnown(false), interned(false) {
 #if(DEBUG)
 			instanceCount++;
 			_prev = nullptr; _next = head;
@@ -32,9 +34,10 @@ namespace MiniScript {
 			head = this;
 #endif
 		}
-		StringStorage(size_t bufSize) : dataSize(bufSize), charCount(-1) {
-			data = new char[bufSize];
-			memset(data, 0, bufSize);
+		// (Use Create for this one, so the bytes come from the same allocation.)
+		StringStorage(size_t bufSize, size_t capacity) : dataSize(bufSize), capacity(capacity), charCount(-1), isASCII(false), hashKnown(false), interned(false) {
+			data = inlineData();
+			if (bufSize) data[bufSize-1] = 0;
 #if(DEBUG)
 			instanceCount++;
 			_prev = nullptr; _next = head;
@@ -43,7 +46,7 @@ namespace MiniScript {
 #endif
 		}
 		virtual ~StringStorage() {
-			if (data) delete[] data;
+			if (data and data != inlineData()) delete[] data;
 #if(DEBUG)
 			instanceCount--;
 			if (_prev) _prev->_next = _next;
@@ -52,12 +55,38 @@ namespace MiniScript {
 #endif
 		}
 		
-		char *data;
+		// Make a storage for bufSize bytes (including the terminating null),
+		// with those bytes following the object itself in a single allocation.
+		// Only the terminator is initialized; the caller fills in the rest.
+		// Optionally, leave room for the string to grow to capacity bytes.
+		// (Any room left in the memory block we get goes to capacity, too.)
+		static StringStorage* Create(size_t bufSize, size_t capacity=0) {
+			if (capacity < bufSize) capacity = bufSize;
+			size_t size = MemoryPool::GoodSize(sizeof(StringStorage) + capacity);
+			MemoryAccount::Charge(size);
+			void *mem = MemoryPool::Allocate(size);
+			return ::new(mem) StringStorage(bufSize, size - sizeof(StringStorage));
+		}
+		// Our size varies, so we free ourselves (by the size we were made with).
+		size_t AllocatedSize() const { return sizeof(StringStorage) + capacity; }
+		virtual void Destroy() {
+			size_t size = AllocatedSize();
+			this->StringStorage::~StringStorage();
+			MemoryAccount::Credit(size);
+			MemoryPool::Free(this, size);
+		}
+		char *inlineData() { return reinterpret_cast<char*>(this + 1); }
+		
+		char *data;			// our bytes: either inlineData(), or a buffer we took over
 		size_t dataSize;
+		size_t capacity;	// bytes available at inlineData() (0 for a buffer we took over)
 		
 		// some cached data for efficiency:
 		long charCount; // -1 when not yet known
 		bool isASCII;   // if charCount > 0 and isASCII==true, then this String is 1 byte per character
+		bool hashKnown; // true when hash below is valid
+		bool interned;  // true if this is (or was) in its thread's intern table
+		unsigned int hash;	// result of String::Hash, once computed
 		
 		friend class String;
 		friend class Value;
@@ -89,7 +118,20 @@ namespace MiniScript {
 		~String() { release(); }
 		
 		// operators
-		String& operator= (const String& other) { if (other != *this) { if (other.ss) other.ss->refCount++; release(); ss = other.ss; isTemp = false; } return *this; }
+		String& operator= (const String& other) { if (other != *this) { if (other.ss) other.ss->retain(); release(); ss = other.ss; isTemp = false; } return *this; }
+		
+		// move constructor and assignment: take over the other's reference
+		// (unless it's a temp, which has none to give, in which case we copy)
+		String(String&& other) noexcept : ss(other.ss), isTemp(false) { if (other.isTemp) retain(); else other.ss = nullptr; }
+		String& operator= (String&& other) noexcept {
+			if (other.isTemp or this == &other) return *this = (const String&)other;
+			StringStorage *storage = other.ss;
+			other.ss = nullptr;
+			release();
+			ss = storage;
+			isTemp = false;
+			return *this;
+		}
 		inline String& operator=(const char c);
 		inline String& operator= (const char* c);
 		inline String operator+ (const String& other) const;
@@ -132,8 +174,9 @@ namespace MiniScript {
 		inline static int Compare(const String& lhs, const String& rhs) { return lhs.Compare(rhs); }
 		inline int Compare(const String& s) const;
 		inline int Compare(const char *c) const;
-		bool operator== (const String& s) const { return Compare(s) == 0; }
-		bool operator!= (const String& s) const { return Compare(s) != 0; }
+		inline bool Equals(const String& s) const;	// (faster than Compare, when you only need equality)
+		bool operator== (const String& s) const { return Equals(s); }
+		bool operator!= (const String& s) const { return not Equals(s); }
 		bool operator> (const String& s) const { return Compare(s) > 0; }
 		bool operator< (const String& s) const { return Compare(s) < 0; }
 		bool operator>= (const String& s) const { return Compare(s) >= 0; }
@@ -146,9 +189,11 @@ namespace MiniScript {
 		bool operator>= (const char *c) const { return Compare(c) >= 0; }
 		bool operator<= (const char *c) const { return Compare(c) <= 0; }
 		
-		// mutators (note: these bind this String to a new storage;
-		// we NEVER mutate the String storage itself)
+		// mutators (note: these bind this String to a new storage; we never
+		// mutate a storage that anything else refers to, but Append may add
+		// to the end of one that belongs to this String alone)
 		inline String& Append(const String& other);
+		inline String& AppendB(const char *buf, size_t bytes);
 		inline String& operator+= (const String& other) { return this->Append(other); }
 		inline String& assign(const String& s) { return (*this = s); }
 		inline String& assign(const char *c) { return (*this = c); }
@@ -179,6 +224,22 @@ namespace MiniScript {
 
 		inline unsigned int Hash() const;
 		
+		// Interning: each thread keeps a table with one shared storage for any
+		// given contents, meant for identifiers and literals (not for every
+		// string made at runtime).  Interned strings aren't charged to any
+		// MemoryAccount.  The table keeps only strings that are in use, plus a
+		// bounded number of others that are dropped now and then (or on
+		// PurgeInterned).  (Don't intern during static initialization, as that
+		// would hash before a host has had a chance to set the hashSeed.)
+		static String Intern(const String& s);			// (adding it to the table if needed)
+		static String LookupInterned(const String& s);	// (or s itself, if not in the table)
+		static void PurgeInterned();					// (drop those nothing else refers to)
+		bool IsInterned() const { return ss and ss->interned; }
+		
+		// Get the shared (interned) one-character string for an ASCII character.
+		// Indexing and splitting text make lots of these, so we never allocate them.
+		static String ASCIIChar(char c);
+		
 		friend class Value;
 		
 	private:
@@ -206,9 +267,8 @@ namespace MiniScript {
 			ss = nullptr;
 		} else {
 
-			ss = new StringStorage(count+1);
+			ss = StringStorage::Create(count+1);
 			for (int i = 0; i < count; i++) ss->data[i] = c;
-			ss->data[count+1] = 0;
 		}
 	}
 
@@ -217,7 +277,7 @@ namespace MiniScript {
 		if (!n) {
 			ss = nullptr;
 		} else {
-			ss = new StringStorage(n+1);
+			ss = StringStorage::Create(n+1);
 			memcpy(ss->data, c, n+1);
 		}
 	}
@@ -226,14 +286,14 @@ namespace MiniScript {
 		if (!bytes) {
 			ss = nullptr;
 		} else {
-			ss = new StringStorage(bytes+1);
+			ss = StringStorage::Create(bytes+1);
 			memcpy(ss->data, buf, bytes);
 			ss->data[bytes] = 0;
 		}
 	}
 
 	inline String::String(const char c) : isTemp(false) {
-		ss = new StringStorage(2);
+		ss = StringStorage::Create(2);
 		ss->data[0] = c;
 		ss->data[1] = 0;
 	}
@@ -244,7 +304,7 @@ namespace MiniScript {
 		if (!n) {
 			ss = nullptr;
 		} else {
-			ss = new StringStorage(n+1);
+			ss = StringStorage::Create(n+1);
 			memcpy(ss->data, c, n+1);
 		}
 		isTemp = false;
@@ -254,7 +314,7 @@ namespace MiniScript {
 	String& String::operator=(const char c) {
 		release();
 		
-		ss = new StringStorage(2);
+		ss = StringStorage::Create(2);
 		ss->data[0] = c;
 		ss->data[1] = 0;
 		
@@ -293,6 +353,20 @@ namespace MiniScript {
 		return strcmp(sa->data, sb->data);
 	}
 
+	bool String::Equals(const String& s) const {
+		StringStorage *sa = ss;
+		if (sa and sa->dataSize <= 1) sa = nullptr;		// normalize empty string and null string
+		StringStorage *sb = s.ss;
+		if (sb and sb->dataSize <= 1) sb = nullptr;
+		if (sa == sb) return true;
+		if (not sa or not sb) return false;
+		// Different lengths, or different hashes (if we know them), mean different
+		// strings; only otherwise do we need to compare the bytes.
+		if (sa->dataSize != sb->dataSize) return false;
+		if (sa->hashKnown and sb->hashKnown and sa->hash != sb->hash) return false;
+		return memcmp(sa->data, sb->data, sa->dataSize - 1) == 0;
+	}
+
 	int String::Compare(const char *c) const {
 		if ((!c or *c == 0) and !ss) return 0;   // both nullptr: equal
 		if (!c or *c == 0) return 1;           // second String nullptr: first is greater
@@ -378,8 +452,9 @@ namespace MiniScript {
 			LengthB = ss->dataSize-1 - posB;
 		}
 		if (posB == 0 and LengthB == (long)ss->dataSize) return *this;
+		if (LengthB == 1 and (unsigned char)ss->data[posB] < 0x80) return ASCIIChar(ss->data[posB]);
 		
-		StringStorage *newbie = new StringStorage(LengthB+1);
+		StringStorage *newbie = StringStorage::Create(LengthB+1);
 		memcpy(newbie->data, ss->data+posB, LengthB);
 
 		#if DEBUG
@@ -393,16 +468,35 @@ namespace MiniScript {
 		if (!other.ss) return *this;  // appending empty String; nothing to do
 		if (!ss) {
 			*this = other;
-		} else {
-			size_t n1 = ss ? ss->dataSize - 1 : 0;
-			size_t n2 = other.ss ? other.ss->dataSize - 1 : 0;
-			StringStorage* newbie = new StringStorage(n1 + n2 + 1);
-			memcpy(newbie->data, ss->data, n1);
-			memcpy(newbie->data+n1, other.ss->data, n2+1);
-			release();
-			ss = newbie;
-			isTemp = false;
+			return *this;
+		}
+		return AppendB(other.ss->data, other.ss->dataSize - 1);
+	}
+
+	inline String& String::AppendB(const char *buf, size_t bytes) {
+		if (!bytes) return *this;
+		size_t n1 = ss ? ss->dataSize - 1 : 0;
+		size_t newSize = n1 + bytes + 1;
+		// If nothing else refers to our storage, then this String is being
+		// built up by appending; add to it in place when there's room, and
+		// otherwise grow it geometrically, so that a series of appends takes
+		// linear time overall.
+		bool ownStorage = (ss and !isTemp and ss->refCount == 1 and !ss->interned
+						   and ss->data == ss->inlineData());
+		if (ownStorage and newSize <= ss->capacity) {
+			memcpy(ss->data + n1, buf, bytes);
+			ss->data[newSize - 1] = 0;
+			ss->dataSize = newSize;
+			ss->charCount = -1;
+			ss->hashKnown = false;
+			return *this;
 		}
+		StringStorage* newbie = StringStorage::Create(newSize, ownStorage ? newSize * 2 : newSize);
+		if (n1) memcpy(newbie->data, ss->data, n1);
+		memcpy(newbie->data + n1, buf, bytes);
+		release();
+		ss = newbie;
+		isTemp = false;
 		return *this;
 	}
 
@@ -444,7 +538,7 @@ namespace MiniScript {
 			return out;
 		}
 		
-		StringStorage *newbie = new StringStorage(newSize +1);
+		StringStorage *newbie = StringStorage::Create(newSize +1);
 		memcpy(newbie->data, start, newSize);
 		out.ss = newbie;
 		
@@ -485,7 +579,7 @@ namespace MiniScript {
 		
 		size_t n1 = ss ? ss->dataSize - 1 : 0;
 		size_t n2 = other.ss ? other.ss->dataSize - 1 : 0;
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::Create(n1 + n2 + 1);
 		memcpy(newbie->data, ss->data, n1);
 		memcpy(newbie->data+n1, other.ss->data, n2+1);
 		return String(newbie, false);		// LEAK
@@ -497,7 +591,7 @@ namespace MiniScript {
 		
 		size_t n1 = ss ? ss->dataSize - 1 : 0;
 		size_t n2 = strlen(c);
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::Create(n1 + n2 + 1);
 		memcpy(newbie->data, ss->data, n1);
 		memcpy(newbie->data+n1, c, n2+1);
 		return String(newbie, false);	// LEAK
@@ -508,7 +602,7 @@ namespace MiniScript {
 		if (!s.ss) return String(c);
 		size_t n1 = strlen(c);
 		size_t n2 = s.ss ? s.ss->dataSize - 1 : 0;
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::Create(n1 + n2 + 1);
 		memcpy(newbie->data, c, n1);
 		memcpy(newbie->data+n1, s.ss->data, n2+1);
 		return String(newbie, false);	// LEAK
@@ -517,7 +611,7 @@ namespace MiniScript {
 	inline String String::ToLower() const {
 		String out;
 		if (ss != nullptr) {
-			out.ss = new StringStorage(ss->dataSize);
+			out.ss = StringStorage::Create(ss->dataSize);
 			memcpy(out.ss->data, ss->data, ss->dataSize);
 			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
 				out.ss->data[i] = tolower(out.ss->data[i]);
@@ -529,7 +623,7 @@ namespace MiniScript {
 	inline String String::ToUpper() const {
 		String out;
 		if (ss) {
-			out.ss = new StringStorage(ss->dataSize);
+			out.ss = StringStorage::Create(ss->dataSize);
 			memcpy(out.ss->data, ss->data, ss->dataSize);
 			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
 				out.ss->data[i] = toupper(out.ss->data[i]);
@@ -546,18 +640,50 @@ namespace MiniScript {
 	bool operator>(const char *cstring, const String &str);
 	bool operator>=(const char *cstring, const String &str);
 
+	// Seed mixed into every string and number hash.  It's 0 by default; a host
+	// worried about maliciously colliding keys can set it to something random,
+	// but it must do so before anything is hashed (i.e. first thing in main).
+	extern unsigned long long hashSeed;
+	
+	// Mix all the bits of a 64-bit word into a 32-bit hash
+	// (the finalizer of MurmurHash3).
+	inline unsigned int hashBits64(unsigned long long x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return (unsigned int)x;
+	}
+
 	unsigned int String::Hash() const {
-		// http://isthe.com/chongo/tech/comp/fnv/#FNV-1a
+		// We compute this once per storage and cache it there, until the storage
+		// is appended to in place (see AppendB), which makes us compute it again.
+		if (ss and ss->hashKnown) return ss->hash;
 		
-		const unsigned int fnv_prime = 16777619u;
-		unsigned int hash = 2166136261u;
+		// Take the bytes 8 at a time, multiplying each word into the hash,
+		// then mix the result thoroughly at the end.
+		const unsigned long long k = 0x9E3779B97F4A7C15ULL;
 		unsigned long bytes = LengthB();
-		for (unsigned long i = 0; i < bytes; i++) {
-			hash ^= ss->data[i];
-			hash *= fnv_prime;
+		unsigned long long hash = hashSeed ^ (bytes * k);
+		const char *p = bytes ? ss->data : nullptr;
+		unsigned long long word;
+		for (; bytes >= 8; bytes -= 8, p += 8) {
+			memcpy(&word, p, 8);
+			hash = (hash ^ word) * k;
+			hash ^= hash >> 32;
 		}
-		
-		return hash;
+		if (bytes) {
+			word = 0;
+			memcpy(&word, p, bytes);
+			hash = (hash ^ word) * k;
+		}
+		unsigned int result = hashBits64(hash);
+		if (ss) {
+			ss->hash = result;
+			ss->hashKnown = true;
+		}
+		return result;
 	}
 	
 	// hash interface compatible with Dictionary:
@@ -8,16 +8,19 @@
 //	switch to the STL vector class or some other container, it shouldn't
 //	be too difficult.
 //
-//	NOTE: this container does bytewise copies of its elements, so it won't
-//	work for classes with non-trivial copy-constructors.  (It's mainly
-//	intended for small elements like numbers and pointers.)
+//	NOTE: this container default-constructs every slot of its buffer, and
+//	moves (or copies) elements into place by assignment.  Slots beyond size()
+//	may hold moved-from (or stale) elements.  The buffer is charged to the
+//	current MemoryAccount.
 
 #ifndef SIMPLEVECTOR_H
 #define SIMPLEVECTOR_H
 
 #include "QA.h"
+#include "MemoryAccount.h"
 
 #include <iostream> // HACK for debugging
+#include <utility>
 
 template <class T>
 class SimpleVector {
@@ -42,6 +45,7 @@ class SimpleVector {
     
 	// insertion (moves all following items)
 	inline void insert(const T& item, const long idx);
+	inline void insert(T&& item, const long idx);
 
     // repositioning -- pluck an element out of idx1, and insert it at idx2
     inline void reposition(const long idx1, const long idx2);
@@ -55,6 +59,7 @@ class SimpleVector {
 	
 	// treating it like a stack
 	inline void push_back(const T& item);		// push onto end of the vector
+	inline void push_back(T&& item);			// (same, moving the item in)
 	inline T pop_back();						// get last item, remove from vector
 	inline T& peek_back();						// get last item, don't remove from vector
 
@@ -103,12 +108,12 @@ inline SimpleVector<T>::SimpleVector(long n)
 	if (n) {
 		#if USE_EXCEPTIONS
 			try {
-				mBuf = new T[mBufItems];
+				mBuf = MiniScript::MemoryAccount::NewArray<T>(mBufItems);
 			} catch (...) {
 				throw memFullErr;
 			}
 		#else
-			mBuf = new T[mBufItems];
+			mBuf = MiniScript::MemoryAccount::NewArray<T>(mBufItems);
 			Assert(mBuf);
 		#endif
 	} else mBuf = nullptr;
@@ -126,24 +131,24 @@ inline SimpleVector<T>::SimpleVector(const SimpleVector<T>& vec)
 template <class T>
 inline SimpleVector<T>& SimpleVector<T>::operator=(const SimpleVector<T>& vec)
 {
-	if (mBuf) delete[] mBuf;
+	if (mBuf) MiniScript::MemoryAccount::DeleteArray(mBuf);
 	mBuf = nullptr;
-	mBlockItems = vec.mBlockItems;
-	mBufItems = vec.mBufItems;
-	mQtyItems = vec.mQtyItems;
+	mBufItems = mQtyItems = 0;
 	#if USE_EXCEPTIONS
 		try {
-			mBuf = new T[mBufItems];
+			mBuf = MiniScript::MemoryAccount::NewArray<T>(vec.mBufItems);
 		} catch (...) {
-			mBufItems = mQtyItems = 0;
 			throw memFullErr;
 		}
 	#else
-		if (mBufItems > 0) {
-			mBuf = new T[mBufItems];
+		if (vec.mBufItems > 0) {
+			mBuf = MiniScript::MemoryAccount::NewArray<T>(vec.mBufItems);
 			Assert(mBuf);
 		}
 	#endif
+	mBlockItems = vec.mBlockItems;
+	mBufItems = vec.mBufItems;
+	mQtyItems = vec.mQtyItems;
 	
 	if (mBuf) {
 		// Mar 04 2002 -- MJS (1)
@@ -161,7 +166,7 @@ inline SimpleVector<T>& SimpleVector<T>::operator=(const SimpleVector<T>& vec)
 template <class T>
 inline SimpleVector<T>::~SimpleVector()
 {
-	if (mBuf) delete[] mBuf;
+	if (mBuf) MiniScript::MemoryAccount::DeleteArray(mBuf);
 //	std::cout << "Delete SimpleVector at " << (long)(this);
 }
 
@@ -260,6 +265,18 @@ inline void SimpleVector<T>::push_back(const T& item)
 	mQtyItems++;
 }
 
+template <class T>
+inline void SimpleVector<T>::push_back(T&& item)
+{
+	while (mQtyItems >= mBufItems) {
+		unsigned long expandBy = (mBlockItems > 0 ? mBlockItems : mBufItems);
+		if (expandBy < 16) expandBy = 16;
+		resizeBuffer( mBufItems + expandBy );
+	}
+	mBuf[mQtyItems] = std::move(item);
+	mQtyItems++;
+}
+
 template <class T>
 inline T SimpleVector<T>::pop_back()
 {
@@ -268,7 +285,7 @@ inline T SimpleVector<T>::pop_back()
 	#else
 		if (mQtyItems > mBufItems || mQtyItems <= 0) Error("pop_back called on empty SimpleVector");;
 	#endif
-	return mBuf[--mQtyItems];
+	return std::move(mBuf[--mQtyItems]);
 }
 
 template <class T>
@@ -309,7 +326,7 @@ inline void SimpleVector<T>::insert(const T& item, const long idx)
 		T* dest = &mBuf[mQtyItems];
 		T* end = &mBuf[idx];
 		while (src >= end) {
-			*dest-- = *src--;
+			*dest-- = std::move(*src--);
 		}
 	}
 	
@@ -318,6 +335,13 @@ inline void SimpleVector<T>::insert(const T& item, const long idx)
 	mQtyItems++;	
 }
 
+template <class T>
+inline void SimpleVector<T>::insert(T&& item, const long idx)
+{
+	T temp(std::move(item));	// (in case item is in our buffer, which insert may move)
+	insert((const T&)temp, idx);
+}
+
 template <class T>
 inline void SimpleVector<T>::reposition(const long idx1, const long idx2)
 {
@@ -332,7 +356,7 @@ inline void SimpleVector<T>::reposition(const long idx1, const long idx2)
 	}
     
     // Grab the item we're moving
-    T mover = mBuf[idx1];
+    T mover = std::move(mBuf[idx1]);
     
     if (idx2 < idx1) {
         // Moving this item towards 0; shift all elements
@@ -341,7 +365,7 @@ inline void SimpleVector<T>::reposition(const long idx1, const long idx2)
 		T* dest = &mBuf[idx1];
 		T* end = &mBuf[idx2];	
 		while (src >= end) {
-			*dest-- = *src--;
+			*dest-- = std::move(*src--);
 		}
     } else {
         // Moving this item away from 0; shift all elements
@@ -350,12 +374,12 @@ inline void SimpleVector<T>::reposition(const long idx1, const long idx2)
 		T* dest = &mBuf[idx1];
 		T* end = &mBuf[idx2+1];	
 		while (src < end) {
-			*dest++ = *src++;
+			*dest++ = std::move(*src++);
 		}		
     }
     
     // Stuff the item we're moving.
-    mBuf[idx2] = mover;
+    mBuf[idx2] = std::move(mover);
 }
 
 template <class T>
@@ -370,6 +394,7 @@ inline void SimpleVector<T>::deleteIdx(const long idx)
 	
 	if (idx == (long)mQtyItems-1) {
 		// special case -- deleting last item, no need to copy
+		mBuf[idx] = T();
 		mQtyItems -= 1;
 	} else {
 		// if deleting any but the last item, move remaining ones down
@@ -378,7 +403,7 @@ inline void SimpleVector<T>::deleteIdx(const long idx)
 		T* src = &mBuf[idx + 1];
 		T* end = &mBuf[mQtyItems];
 		while(src < end) {
-			*dest++ = *src++;
+			*dest++ = std::move(*src++);
 		}
 		mQtyItems -= 1;
 	}
@@ -405,7 +430,7 @@ inline void SimpleVector<T>::deleteIdx(const long idx)
 template <class T>
 inline void SimpleVector<T>::deleteAll()
 {
-	delete[] mBuf;
+	MiniScript::MemoryAccount::DeleteArray(mBuf);
 	mBuf = nullptr;
 	mBufItems = mQtyItems = 0;
 }
@@ -428,16 +453,16 @@ template <class T>
 inline void SimpleVector<T>::resizeBuffer(long n)
 {
 	if (n == (long)mBufItems) return;
-	T *newbuf = new T[n];
+	T *newbuf = MiniScript::MemoryAccount::NewArray<T>(n);
 //	if (!newbuf) throw memFullErr;	// (not needed, as new now throws if it fails)
 	if (mBuf) {
 		T* src = mBuf;
 		T* dest = newbuf;
 		T* end = &mBuf[((long)mQtyItems < n) ? mQtyItems : n];	// the smaller value
 		while (src < end) {
-			*dest++ = *src++;
+			*dest++ = std::move(*src++);
 		}
-		delete[] mBuf;
+		MiniScript::MemoryAccount::DeleteArray(mBuf);
 	}
 	mBuf = newbuf;
 	mBufItems = n;
@@ -457,9 +482,9 @@ inline void SimpleVector<T>::reverse() {
     unsigned long high = mQtyItems - 1;
     
     while (low < high) {
-        T temp = mBuf[low];
-        mBuf[low] = mBuf[high];
-        mBuf[high] = temp;
+        T temp = std::move(mBuf[low]);
+        mBuf[low] = std::move(mBuf[high]);
+        mBuf[high] = std::move(temp);
         low++;
         high--;
     }
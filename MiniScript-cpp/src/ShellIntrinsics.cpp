@@ -650,7 +650,7 @@ static String ReadFileHelper(FILE *handle, long bytesToRead) {
 	while (!feof(handle) && (bytesToRead != 0)) {
 		size_t read = fread(buf, 1, bytesToRead > 0 && bytesToRead < 1024 ? bytesToRead : 1024, handle);
 		if (bytesToRead > 0) bytesToRead -= read;
-		result += String(buf, read);
+		result.AppendB(buf, read);
 	}
 	return result;
 }
@@ -749,7 +749,7 @@ static IntrinsicResult intrinsic_readLines(Context *context, IntrinsicResult par
 			}
 		}
 		if (lineStart < bytesRead) {
-			partialLine += String(&buf[lineStart], bytesRead - lineStart);
+			partialLine.AppendB(&buf[lineStart], bytesRead - lineStart);
 		}
 	}
 	if (!partialLine.empty()) list.Add(partialLine);
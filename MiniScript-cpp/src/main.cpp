@@ -69,9 +69,12 @@ static void PrintHelp(String cmdPath) {
 	Print("-h     : print this help message and exit (also -? or --help)");
 	Print("-i     : enter interactive mode after executing 'file'");
 	Print("--itest suite_file : run integration tests");
+	Print("-O0, -O1, -O2 : set the optimization level (default: -O" + String::Format(Optimizer::defaultLevel) + ")");
 	Print("-q     : suppress header info");
 	Print("file   : program read from script file");
 	Print("-      : program read from stdin (default; interactive mode if a tty)");
+	Print("Environment variables:");
+	Print("MS_HASHSEED : seed for hashing map keys (a number, or \"random\")");
 }
 
 void ConfigInterpreter(Interpreter &interp) {
@@ -116,18 +119,28 @@ static int DoREPL(Interpreter &interp) {
 	}
 }
 
+// Print the given code, followed by that of each function it defines.
+static void DumpTAC(List<TACLine>& code, String name="") {
+	if (not name.empty()) std::cout << std::endl << name << ":" << std::endl;
+	for (long i=0; i<code.Count(); i++) {
+		std::cout << i << ". " << code[i].ToString() << std::endl;
+	}
+	for (long i=0; i<code.Count(); i++) {
+		Value func = code[i].rhsA;
+		if (func.type != ValueType::Function) continue;
+		String funcName = name.empty() ? String("function") : name + " > function";
+		funcName += " at line " + String::Format((int)i);
+		DumpTAC(((FunctionStorage*)func.data.ref)->code, funcName);
+	}
+}
+
 static int DoCommand(Interpreter &interp, String cmd) {
 	interp.Reset(cmd);
 	interp.Compile();
 	
 //	std::cout << cmd << std::endl;
 	
-	if (dumpTAC) {
-		Context *c = interp.vm->GetGlobalContext();
-		for (long i=0; i<c->code.Count(); i++) {
-			std::cout << i << ". " << c->code[i].ToString() << std::endl;
-		}
-	}
+	if (dumpTAC) DumpTAC(interp.vm->GetGlobalContext()->code);
 	
 	while (!interp.Done()) {
 		try {
@@ -171,12 +184,13 @@ static void PrintToTestOutput(String s, bool lineBreak=true) {
 }
 
 static void DoOneIntegrationTest(List<String> sourceLines, long sourceLineNum,
-				 List<String> expectedOutput, long outputLineNum) {
+				 List<String> expectedOutput, long outputLineNum, int optimizationLevel) {
 //	std::cout << "Running test starting at line " << sourceLineNum << std::endl;
 	
 	testOutput.Clear();
 	{
 		Interpreter miniscript(sourceLines);
+		miniscript.optimizationLevel = optimizationLevel;
 		miniscript.standardOutput = &PrintToTestOutput;
 		miniscript.errorOutput = &PrintToTestOutput;
 		miniscript.implicitOutput = &PrintToTestOutput;
@@ -205,7 +219,7 @@ static void DoOneIntegrationTest(List<String> sourceLines, long sourceLineNum,
 	testOutput.Clear();
 }
 
-void RunIntegrationTests(String path) {
+void RunIntegrationTests(String path, int optimizationLevel) {
 	std::ifstream infile(path.c_str());
 
 	if (!infile.is_open()) {
@@ -229,7 +243,7 @@ void RunIntegrationTests(String path) {
 
 		if (line.StartsWith("====")) {
 			if (sourceLines.Count() > 0 && sourceLines[0][0] < 0x80) {
-				DoOneIntegrationTest(sourceLines, testLineNum, expectedOutput, outputLineNum);
+				DoOneIntegrationTest(sourceLines, testLineNum, expectedOutput, outputLineNum, optimizationLevel);
 			}
 			sourceLines.Clear();
 			expectedOutput.Clear();
@@ -246,7 +260,7 @@ void RunIntegrationTests(String path) {
 		}
 	}
 	if (sourceLines.Count() > 0) {
-		DoOneIntegrationTest(sourceLines, testLineNum, expectedOutput, outputLineNum);
+		DoOneIntegrationTest(sourceLines, testLineNum, expectedOutput, outputLineNum, optimizationLevel);
 	}
 	Print("\nIntegration tests complete.\n");
 }
@@ -259,8 +273,26 @@ void PrepareShellArgs(int argc, const char* argv[], int startingAt) {
 	shellArgs = args;
 }
 
+#if MINISCRIPT_COUNT_RETAINS
+static void PrintRetainCounts() {
+	std::cerr << "retains: " << RefCountedStorage::retainCount
+		<< ", releases: " << RefCountedStorage::releaseCount << std::endl;
+}
+#endif
+
 int main(int argc, const char * argv[]) {
+#if MINISCRIPT_COUNT_RETAINS
+	atexit(PrintRetainCounts);
+#endif
 	
+	// Seed map key hashes, if requested -- before anything gets hashed.
+	const char *seed = getenv("MS_HASHSEED");
+	if (seed and strcmp(seed, "random") == 0) {
+		MiniScript::hashSeed = std::chrono::high_resolution_clock::now().time_since_epoch().count() ^ (unsigned long long)&seed;
+	} else if (seed) {
+		MiniScript::hashSeed = strtoull(seed, nullptr, 10);
+	}
+
 #if(DEBUG)
 	std::cout << "StringStorage instances at start (from static keywords, etc.): " << StringStorage::instanceCount << std::endl;
 	std::cout << "total RefCountedStorage instances at start (from static keywords, etc.): " << RefCountedStorage::instanceCount << std::endl;
@@ -308,11 +340,13 @@ int main(int argc, const char * argv[]) {
 			return DoCommand(interp, cmd);
 		} else if (arg == "--dumpTAC") {
 			dumpTAC = true;
+		} else if (arg.StartsWith("-O") and arg.LengthB() == 3 and arg[2] >= '0' and arg[2] <= '0' + Optimizer::maxLevel) {
+			interp.optimizationLevel = arg[2] - '0';
 		} else if (arg == "--itest") {
 			PrintHeaderInfo();
 			i++;
 			if (i >= argc) return ReturnErr("Path to test suite expected after --itest option");
-			RunIntegrationTests(argv[i]);
+			RunIntegrationTests(argv[i], interp.optimizationLevel);
 			return 0;
 		} else if (arg == "-") {
 			PrintHeaderInfo();